@@ -0,0 +1,423 @@
+#ifndef AST_H
+#define AST_H
+
+// Abstract syntax tree built by semantic actions that run on the parser's
+// reductions. Nodes and their child arrays are bump-allocated in an Arena and
+// released together with the tree.
+
+#include "lexer.h"
+#include "parser.h"
+
+enum class NodeKind : uint8_t
+{
+    Program,     // children: functions and global statements
+    Function,    // type, name; children: Param..., Block
+    Param,       // type, name
+    Block,       // children: statements
+    Declaration, // type, name; children: [initializer]
+    Assignment,  // name; children: value
+    Read,        // name
+    Print,       // name
+    Return,      // children: [value]
+    ExprStmt,    // children: expression
+    IfElse,      // children: condition, then Block, else Block
+    Binary,      // op; children: left, right (also the LT/GT/EQ condition)
+    Unary,       // op; children: operand
+    Call,        // name; children: arguments
+    Variable,    // name
+    Increment,   // name (ID++)
+    IntLiteral,
+    FloatLiteral
+};
+
+inline const char *nodeKindName(NodeKind kind)
+{
+    static const char *names[] = {"Program", "Function", "Param", "Block", "Declaration", "Assignment",
+                                  "Read", "Print", "Return", "ExprStmt", "IfElse", "Binary", "Unary",
+                                  "Call", "Variable", "Increment", "IntLiteral", "FloatLiteral"};
+    return names[static_cast<int>(kind)];
+}
+
+struct AstNode
+{
+    NodeKind kind;
+    TypeKind type = TypeKind::Int; // Function, Param, Declaration
+    TokenType op = TOKEN_ERROR;    // Binary, Unary
+    uint32_t symbol = NO_SYMBOL;   // Interned name, for nodes that have one
+    uint32_t child_count = 0;
+    AstNode **children = nullptr;  // child_count entries, contiguous in the arena
+    string_view text;              // Name, operator or literal lexeme (a slice of the source)
+    Position pos;
+};
+
+// The tree of one compilation.
+struct Ast
+{
+    Arena arena;
+    AstNode *root = nullptr;
+    size_t node_count = 0;
+
+    AstNode *make(NodeKind kind, Position pos, size_t child_count = 0)
+    {
+        AstNode *node = arena.make<AstNode>();
+        node->kind = kind;
+        node->pos = pos;
+        node->child_count = child_count;
+        if (child_count)
+            node->children = arena.makeArray<AstNode *>(child_count);
+        node_count++;
+        return node;
+    }
+
+    // Node for a named entity: the name, its symbol and position come from id.
+    AstNode *make(NodeKind kind, const Token &id, size_t child_count = 0)
+    {
+        AstNode *node = make(kind, id.pos, child_count);
+        node->symbol = id.symbol;
+        node->text = id.lexeme;
+        return node;
+    }
+
+    void print(ostream &out) const
+    {
+        if (root)
+            print(out, root, 0);
+    }
+
+private:
+    static void print(ostream &out, const AstNode *node, int depth)
+    {
+        out << string(depth * 2, ' ') << nodeKindName(node->kind);
+        if (node->kind == NodeKind::Function || node->kind == NodeKind::Param || node->kind == NodeKind::Declaration)
+            out << " " << typeName(node->type);
+        if (!node->text.empty())
+            out << " " << node->text;
+        out << " [" << positionToString(node->pos) << "]\n";
+        for (uint32_t i = 0; i < node->child_count; i++)
+            print(out, node->children[i], depth + 1);
+    }
+};
+
+// What a reduction does with the values of its right-hand side.
+enum class AstAction : uint8_t
+{
+    Pass,        // Value of the first symbol (a node, a token or a list)
+    PassSecond,  // Value of the second symbol: ( e ), = e
+    None,        // No node: an omitted initializer or return value
+    ListEmpty,
+    ListOne,     // A list holding the first symbol's node
+    Cons,        // First symbol's node in front of the list that is the last symbol
+    Function,
+    Param,
+    Declaration,
+    Assignment,
+    Read,
+    Print,
+    Return,
+    ExprStmt,
+    IfElse,
+    Binary,
+    Unary,
+    VariableOrCall,
+    PostfixIncrement,
+    PostfixCall,
+    PostfixNone,
+    Literal
+};
+
+// Semantic action of every production, matched by its text when the grammar
+// is loaded. A production without a rule is an error, so a grammar change
+// cannot silently drop part of the tree.
+class AstRules
+{
+public:
+    vector<AstAction> action;   // Per production
+    vector<uint8_t> rhs_length; // Per production
+
+    explicit AstRules(const Grammar &grammar)
+    {
+        static const struct
+        {
+            const char *lhs;
+            const char *rhs;
+            AstAction action;
+        } rules[] = {
+            {"<program>", "<element> <program>", AstAction::Cons},
+            {"<program>", "", AstAction::ListEmpty},
+            {"<element>", "<function>", AstAction::Pass},
+            {"<element>", "<global_statement>", AstAction::Pass},
+            {"<global_statement>", "<declaration>", AstAction::Pass},
+            {"<global_statement>", "<assignment>", AstAction::Pass},
+            {"<global_statement>", "<expression_stmt>", AstAction::Pass},
+            {"<global_statement>", "<read_stmt>", AstAction::Pass},
+            {"<global_statement>", "<print_stmt>", AstAction::Pass},
+            {"<function>", "<type> ID LPAREN <params> RPAREN LBRACE <statements> RBRACE", AstAction::Function},
+            {"<params>", "<param_list>", AstAction::Pass},
+            {"<params>", "", AstAction::ListEmpty},
+            {"<param_list>", "<param> COMMA <param_list>", AstAction::Cons},
+            {"<param_list>", "<param>", AstAction::ListOne},
+            {"<param>", "<type> ID", AstAction::Param},
+            {"<type>", "INT", AstAction::Pass},
+            {"<type>", "FLOAT", AstAction::Pass},
+            {"<type>", "VOID", AstAction::Pass},
+            {"<statements>", "<statement> <statements>", AstAction::Cons},
+            {"<statements>", "", AstAction::ListEmpty},
+            {"<statement>", "<declaration>", AstAction::Pass},
+            {"<statement>", "<read_stmt>", AstAction::Pass},
+            {"<statement>", "<print_stmt>", AstAction::Pass},
+            {"<statement>", "<if_else_stmt>", AstAction::Pass},
+            {"<statement>", "<assignment>", AstAction::Pass},
+            {"<statement>", "<expression_stmt>", AstAction::Pass},
+            {"<statement>", "<return_stmt>", AstAction::Pass},
+            {"<declaration>", "<type> ID <optional_init> SEMICOLON", AstAction::Declaration},
+            {"<optional_init>", "EQUALS <expression>", AstAction::PassSecond},
+            {"<optional_init>", "", AstAction::None},
+            {"<read_stmt>", "READ ID SEMICOLON", AstAction::Read},
+            {"<print_stmt>", "PRINT ID SEMICOLON", AstAction::Print},
+            {"<return_stmt>", "RETURN <optional_ret_value> SEMICOLON", AstAction::Return},
+            {"<optional_ret_value>", "<expression>", AstAction::Pass},
+            {"<optional_ret_value>", "", AstAction::None},
+            {"<if_else_stmt>", "IF LPAREN <condition> RPAREN LBRACE <statements> RBRACE ELSE LBRACE <statements> RBRACE", AstAction::IfElse},
+            {"<condition>", "<additive_expression> <rel_op> <additive_expression>", AstAction::Binary},
+            {"<rel_op>", "LT", AstAction::Pass},
+            {"<rel_op>", "GT", AstAction::Pass},
+            {"<rel_op>", "EQ", AstAction::Pass},
+            {"<assignment>", "ID EQUALS <expression> SEMICOLON", AstAction::Assignment},
+            {"<expression>", "<additive_expression>", AstAction::Pass},
+            {"<additive_expression>", "<additive_expression> PLUS <term>", AstAction::Binary},
+            {"<additive_expression>", "<additive_expression> MINUS <term>", AstAction::Binary},
+            {"<additive_expression>", "<term>", AstAction::Pass},
+            {"<term>", "<term> MULTIPLY <factor>", AstAction::Binary},
+            {"<term>", "<term> DIVIDE <factor>", AstAction::Binary},
+            {"<term>", "<term> MOD <factor>", AstAction::Binary},
+            {"<term>", "<factor>", AstAction::Pass},
+            {"<factor>", "<variable_or_call>", AstAction::Pass},
+            {"<factor>", "LPAREN <expression> RPAREN", AstAction::PassSecond},
+            {"<factor>", "<literal>", AstAction::Pass},
+            {"<factor>", "<unary_op> <factor>", AstAction::Unary},
+            {"<variable_or_call>", "ID <postfix_or_call>", AstAction::VariableOrCall},
+            {"<postfix_or_call>", "INCREMENT", AstAction::PostfixIncrement},
+            {"<postfix_or_call>", "LPAREN <args> RPAREN", AstAction::PostfixCall},
+            {"<postfix_or_call>", "", AstAction::PostfixNone},
+            {"<args>", "<expression_list>", AstAction::Pass},
+            {"<args>", "", AstAction::ListEmpty},
+            {"<expression_list>", "<expression> COMMA <expression_list>", AstAction::Cons},
+            {"<expression_list>", "<expression>", AstAction::ListOne},
+            {"<literal>", "INT_LIT", AstAction::Literal},
+            {"<literal>", "FLOAT_LIT", AstAction::Literal},
+            {"<unary_op>", "PLUS", AstAction::Pass},
+            {"<unary_op>", "MINUS", AstAction::Pass},
+            {"<expression_stmt>", "<expression> SEMICOLON", AstAction::ExprStmt},
+        };
+
+        map<pair<string, string>, AstAction> by_text;
+        for (const auto &rule : rules)
+            by_text[{rule.lhs, rule.rhs}] = rule.action;
+
+        for (const auto &prod : grammar.productions)
+        {
+            string rhs;
+            for (int sym : prod.rhs)
+                rhs += (rhs.empty() ? "" : " ") + grammar.name(sym);
+            auto it = by_text.find({grammar.name(prod.lhs), rhs});
+            if (it == by_text.end() && prod.lhs != grammar.augmented_start)
+                throw runtime_error("No AST action for " + grammar.name(prod.lhs) + " -> " + rhs);
+            action.push_back(it != by_text.end() ? it->second : AstAction::Pass);
+            rhs_length.push_back(prod.rhs.size());
+        }
+    }
+};
+
+// Parser actions (see NoActions) that build an Ast. Every shifted token and
+// every reduced non-terminal gets an entry on a value stack that runs in step
+// with the parser's state stack.
+//
+// Lists (<statements>, <params>, <args>, <program>) are right-recursive, so
+// their reductions run from the last element to the first and, once a list's
+// first reduction has run, nothing else is reduced until the list is
+// complete. Their elements are therefore collected on one shared pending
+// stack; a list value is just its range there, and the node that owns the
+// list copies the range into a contiguous child array and pops it.
+class AstBuilder
+{
+    struct Value
+    {
+        AstNode *node = nullptr;
+        Token token;             // Shifted terminal, or the one passed up by <type>, <rel_op>, <unary_op>
+        uint32_t list_start = 0; // Lists: pending[list_start, list_start + list_count),
+        uint32_t list_count = 0; // last element first
+        NodeKind form = NodeKind::Variable; // What <postfix_or_call> makes of the ID before it
+    };
+
+    const AstRules &rules;
+    Ast &ast;
+    vector<Value> values;
+    vector<AstNode *> pending;
+
+public:
+    Token next; // The token being pushed; set before each Parser::push
+
+    AstBuilder(const AstRules &rules, Ast &ast) : rules(rules), ast(ast)
+    {
+        values.reserve(256);
+    }
+
+    void shift()
+    {
+        values.emplace_back();
+        values.back().token = next;
+    }
+
+    void reduce(int prod)
+    {
+        size_t length = rules.rhs_length[prod];
+        Value *v = values.data() + values.size() - length;
+        Value result;
+        switch (rules.action[prod])
+        {
+        case AstAction::Pass:
+            result = v[0];
+            break;
+        case AstAction::PassSecond:
+            result = v[1];
+            break;
+        case AstAction::None:
+            break;
+        case AstAction::ListEmpty:
+            result.list_start = pending.size();
+            break;
+        case AstAction::ListOne:
+            result.list_start = pending.size();
+            result.list_count = 1;
+            pending.push_back(v[0].node);
+            break;
+        case AstAction::Cons:
+            result = v[length - 1];
+            result.list_count++;
+            pending.push_back(v[0].node);
+            break;
+        case AstAction::Function:
+        {
+            const Value &params = v[3];
+            AstNode *node = ast.make(NodeKind::Function, v[1].token, params.list_count + 1);
+            node->type = typeFromToken(v[0].token.type);
+            take(params, node->children);
+            node->children[params.list_count] = block(v[6], v[5].token);
+            pending.resize(params.list_start);
+            result.node = node;
+            break;
+        }
+        case AstAction::Param:
+            result.node = ast.make(NodeKind::Param, v[1].token);
+            result.node->type = typeFromToken(v[0].token.type);
+            break;
+        case AstAction::Declaration:
+            result.node = ast.make(NodeKind::Declaration, v[1].token, v[2].node ? 1 : 0);
+            result.node->type = typeFromToken(v[0].token.type);
+            if (v[2].node)
+                result.node->children[0] = v[2].node;
+            break;
+        case AstAction::Assignment:
+            result.node = ast.make(NodeKind::Assignment, v[0].token, 1);
+            result.node->children[0] = v[2].node;
+            break;
+        case AstAction::Read:
+        case AstAction::Print:
+            result.node = ast.make(rules.action[prod] == AstAction::Read ? NodeKind::Read : NodeKind::Print, v[1].token);
+            result.node->pos = v[0].token.pos;
+            break;
+        case AstAction::Return:
+            result.node = ast.make(NodeKind::Return, v[0].token.pos, v[1].node ? 1 : 0);
+            if (v[1].node)
+                result.node->children[0] = v[1].node;
+            break;
+        case AstAction::ExprStmt:
+            result.node = ast.make(NodeKind::ExprStmt, v[0].node->pos, 1);
+            result.node->children[0] = v[0].node;
+            break;
+        case AstAction::IfElse:
+        {
+            AstNode *node = ast.make(NodeKind::IfElse, v[0].token.pos, 3);
+            node->children[0] = v[2].node;
+            node->children[1] = block(v[5], v[4].token);
+            node->children[2] = block(v[9], v[8].token);
+            pending.resize(v[5].list_start);
+            result.node = node;
+            break;
+        }
+        case AstAction::Binary:
+            result.node = operation(NodeKind::Binary, v[1].token, 2);
+            result.node->children[0] = v[0].node;
+            result.node->children[1] = v[2].node;
+            break;
+        case AstAction::Unary:
+            result.node = operation(NodeKind::Unary, v[0].token, 1);
+            result.node->children[0] = v[1].node;
+            break;
+        case AstAction::VariableOrCall:
+        {
+            const Value &postfix = v[1];
+            result.node = ast.make(postfix.form, v[0].token, postfix.form == NodeKind::Call ? postfix.list_count : 0);
+            if (postfix.form == NodeKind::Call)
+            {
+                take(postfix, result.node->children);
+                pending.resize(postfix.list_start);
+            }
+            break;
+        }
+        case AstAction::PostfixIncrement:
+            result.form = NodeKind::Increment;
+            break;
+        case AstAction::PostfixCall:
+            result = v[1];
+            result.form = NodeKind::Call;
+            break;
+        case AstAction::PostfixNone:
+            result.form = NodeKind::Variable;
+            break;
+        case AstAction::Literal:
+            result.node = ast.make(v[0].token.type == TOKEN_FLOAT_LIT ? NodeKind::FloatLiteral : NodeKind::IntLiteral, v[0].token.pos);
+            result.node->text = v[0].token.lexeme;
+            break;
+        }
+        values.resize(values.size() - length);
+        values.push_back(result);
+    }
+
+    // Called once the parser has accepted: wraps the top-level list in the
+    // Program node and hands the tree to ast.
+    AstNode *finish()
+    {
+        const Value &program = values.back();
+        AstNode *root = ast.make(NodeKind::Program, Position(), program.list_count);
+        take(program, root->children);
+        pending.clear();
+        values.clear();
+        return ast.root = root;
+    }
+
+private:
+    // Copies a list's elements, which sit last-first on pending, in order.
+    void take(const Value &list, AstNode **out)
+    {
+        for (uint32_t i = 0; i < list.list_count; i++)
+            out[i] = pending[list.list_start + list.list_count - 1 - i];
+    }
+
+    AstNode *block(const Value &list, const Token &lbrace)
+    {
+        AstNode *node = ast.make(NodeKind::Block, lbrace.pos, list.list_count);
+        take(list, node->children);
+        return node;
+    }
+
+    AstNode *operation(NodeKind kind, const Token &op, size_t child_count)
+    {
+        AstNode *node = ast.make(kind, op.pos, child_count);
+        node->op = op.type;
+        node->text = op.lexeme;
+        return node;
+    }
+};
+
+#endif
@@ -0,0 +1,147 @@
+// Checks that TableCache rejects damaged cache files instead of handing the
+// parser out-of-range tables: each case corrupts one part of a freshly saved
+// cache and expects load() to fail and load_tables() to rebuild.
+//
+//   g++ -O2 -pthread cache_check.cpp -o cache_check
+//   ./cache_check Grammar.txt
+
+#include "parser.h"
+
+// Scratch copy of the grammar, so its cache file can be damaged freely.
+const char *GRAMMAR_COPY = "cache_check_grammar.txt";
+
+string read_file(const string &filename)
+{
+    ifstream file(filename, ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+void write_file(const string &filename, const string &data)
+{
+    ofstream file(filename, ios::binary | ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+// Byte offsets of the sections of a cache file, from its header.
+struct CacheLayout
+{
+    TableCacheHeader header;
+    size_t names, lhs, length, rhs, action, goto_cells, end;
+
+    explicit CacheLayout(const string &data)
+    {
+        memcpy(&header, data.data(), sizeof(header));
+        names = sizeof(header);
+        lhs = names + ((header.names_bytes + 3) & ~(size_t)3);
+        length = lhs + header.num_productions * sizeof(int32_t);
+        rhs = length + header.num_productions * sizeof(int32_t);
+        action = rhs + header.rhs_symbols * sizeof(int32_t);
+        goto_cells = action + (size_t)header.num_states * header.num_terminals * sizeof(int32_t);
+        end = data.size();
+    }
+};
+
+void set_cell(string &data, size_t offset, int32_t value)
+{
+    memcpy(&data[offset], &value, sizeof(value));
+}
+
+// Recomputes the checksum, so that only the content checks can catch the damage.
+void reseal(string &data)
+{
+    TableCacheHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    header.checksum = TableCache::checksum(2166136261u, data.data() + sizeof(header), data.size() - sizeof(header));
+    memcpy(&data[0], &header, sizeof(header));
+}
+
+int main(int argc, char *argv[])
+{
+    string grammar_file = argc > 1 ? argv[1] : "Grammar.txt";
+    TableMode mode = TABLE_CLR;
+    int failures = 0;
+
+    try
+    {
+        write_file(GRAMMAR_COPY, read_file(grammar_file));
+        string cache_file = TableCache::path(GRAMMAR_COPY, mode);
+        uint64_t key = TableCache::key(GRAMMAR_COPY, mode);
+        remove(cache_file.c_str());
+
+        Grammar reference_grammar;
+        CanonicalLR1 reference;
+        load_tables(GRAMMAR_COPY, mode, true, 1, reference_grammar, reference);
+        const string good = read_file(cache_file);
+        const CacheLayout layout(good);
+        int32_t states = layout.header.num_states;
+        int32_t productions = layout.header.num_productions;
+
+        auto check = [&](const char *name, bool passed)
+        {
+            cout << (passed ? "PASS " : "FAIL ") << name << endl;
+            failures += !passed;
+        };
+
+        {
+            Grammar grammar;
+            CanonicalLR1 clr;
+            bool loaded = TableCache::load(cache_file, key, mode, grammar, clr);
+            check("intact cache loads", loaded && clr.tables.action == reference.tables.action &&
+                                            clr.tables.goto_state == reference.tables.goto_state);
+        }
+
+        struct Damage
+        {
+            const char *name;
+            function<void(string &)> apply;
+        };
+        vector<Damage> cases = {
+            {"flipped action cell, checksum stale", [&](string &d)
+             { d[layout.action + 4] ^= 0x40; }},
+            {"shift past the last state", [&](string &d)
+             { set_cell(d, layout.action, encodeAction(ACTION_SHIFT, states + 5)); reseal(d); }},
+            {"reduce past the last production", [&](string &d)
+             { set_cell(d, layout.action, encodeAction(ACTION_REDUCE, productions)); reseal(d); }},
+            {"goto past the last state", [&](string &d)
+             { set_cell(d, layout.goto_cells, states); reseal(d); }},
+            {"negative goto", [&](string &d)
+             { set_cell(d, layout.goto_cells, -7); reseal(d); }},
+            {"production lengths not matching rhs", [&](string &d)
+             { set_cell(d, layout.length, 1000000); reseal(d); }},
+            {"zero states", [&](string &d)
+             { TableCacheHeader h = layout.header; h.num_states = 0; memcpy(&d[0], &h, sizeof(h)); }},
+            {"truncated", [&](string &d)
+             { d.resize(layout.goto_cells); }},
+        };
+
+        for (const Damage &damage : cases)
+        {
+            string data = good;
+            damage.apply(data);
+            write_file(cache_file, data);
+
+            Grammar grammar;
+            CanonicalLR1 clr;
+            bool rejected = !TableCache::load(cache_file, key, mode, grammar, clr) && grammar.symbol_names.empty();
+
+            // The full path must rebuild the same tables rather than crash
+            Grammar rebuilt_grammar;
+            CanonicalLR1 rebuilt;
+            bool from_cache = load_tables(GRAMMAR_COPY, mode, true, 1, rebuilt_grammar, rebuilt);
+            bool same = rebuilt.tables.action == reference.tables.action &&
+                        rebuilt.tables.goto_state == reference.tables.goto_state;
+            check(damage.name, rejected && !from_cache && same);
+        }
+
+        remove(cache_file.c_str());
+        remove(GRAMMAR_COPY);
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    cout << (failures ? to_string(failures) + " check(s) failed." : "All cache checks passed.") << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+// Checks a header written by parser --emit-cpp against the tables parser.h
+// builds for the same grammar: the arrays must match cell for cell, and the
+// generated parse() must accept exactly the inputs Parser accepts.
+//
+//   ./parser --table lalr --emit-cpp grammar_tables.hpp Grammar.txt
+//   g++ -O2 -pthread -DGENERATED_TABLES='"grammar_tables.hpp"' emit_check.cpp -o emit_check
+//   ./emit_check --table lalr Grammar.txt sample.txt.parse
+
+#include "parser.h"
+
+#ifndef GENERATED_TABLES
+#define GENERATED_TABLES "grammar_tables.hpp"
+#endif
+#include GENERATED_TABLES
+
+template <size_t N>
+bool same_cells(const char *name, const int32_t (&generated)[N], const vector<int32_t> &built)
+{
+    // Empty arrays are emitted with one dummy cell
+    if (built.size() == N || (built.empty() && N == 1))
+    {
+        if (equal(built.begin(), built.end(), generated))
+            return true;
+    }
+    cerr << name << " differs from the built tables" << endl;
+    return false;
+}
+
+// Token names of a .parse file, binary or text.
+vector<string> read_names(const string &filename)
+{
+    vector<string> names;
+    {
+        SourceBuffer file(filename);
+        if (!TokenStreamReader::isTokenStream(file.view()))
+        {
+            stringstream ss{string(file.view())};
+            string name;
+            while (ss >> name)
+                names.push_back(name);
+            return names;
+        }
+    }
+    TokenStreamReader stream(filename);
+    for (const TokenRecord &record : stream)
+        names.push_back(tokenTypeToString(static_cast<TokenType>(record.kind)));
+    return names;
+}
+
+int main(int argc, char *argv[])
+{
+    TableMode mode = TABLE_CLR;
+    vector<string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--table" && i + 1 < argc)
+        {
+            string value = argv[++i];
+            mode = value == "lalr" ? TABLE_LALR : value == "ielr" ? TABLE_IELR : TABLE_CLR;
+        }
+        else
+            files.push_back(arg);
+    }
+    if (files.empty())
+    {
+        cerr << "Usage: " << argv[0] << " [--table lalr|ielr|clr] <grammar_file> [input.parse...]" << endl;
+        return 1;
+    }
+
+    try
+    {
+        Grammar grammar;
+        CanonicalLR1 clr;
+        load_tables(files[0], mode, false, 1, grammar, clr);
+        const ParseTables &tables = clr.tables;
+
+        bool ok = generated_parser::NUM_STATES == tables.num_states &&
+                  generated_parser::NUM_TERMINALS == tables.num_terminals &&
+                  generated_parser::NUM_SYMBOLS == (int)grammar.symbol_names.size();
+        if (!ok)
+            cerr << "table dimensions differ from the built tables" << endl;
+        ok &= same_cells("ACTION", generated_parser::ACTION, tables.action);
+        ok &= same_cells("GOTO", generated_parser::GOTO, tables.goto_state);
+        ok &= same_cells("PRODUCTION_LHS", generated_parser::PRODUCTION_LHS, tables.production_lhs);
+        ok &= same_cells("PRODUCTION_LENGTH", generated_parser::PRODUCTION_LENGTH, tables.production_length);
+
+        Parser parser(clr);
+        vector<int> stack;
+        for (size_t f = 1; f < files.size(); f++)
+        {
+            vector<string> names = read_names(files[f]);
+            vector<int> ids, built_ids;
+            for (const auto &name : names)
+            {
+                ids.push_back(generated_parser::terminalId(name));
+                built_ids.push_back(grammar.terminal_id(name));
+            }
+            built_ids.push_back(END_MARKER);
+            bool generated = generated_parser::parse(ids.data(), ids.size(), stack);
+            bool built = parser.parse(built_ids);
+            cout << files[f] << ": " << (generated ? "valid" : "invalid") << endl;
+            if (generated != built)
+            {
+                cerr << files[f] << ": Parser says " << (built ? "valid" : "invalid") << endl;
+                ok = false;
+            }
+        }
+        cout << (ok ? "Generated parser matches." : "Generated parser differs.") << endl;
+        return ok ? 0 : 1;
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,81 @@
+#include "frontend.h"
+
+int main(int argc, char *argv[])
+{
+    vector<string> files;
+    TableMode mode = TABLE_CLR;
+    bool use_cache = true;
+    CompileOptions options;
+    bool usage_error = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--table")
+        {
+            string value = i + 1 < argc ? argv[++i] : "";
+            if (value == "clr")
+                mode = TABLE_CLR;
+            else if (value == "lalr")
+                mode = TABLE_LALR;
+            else if (value == "ielr")
+                mode = TABLE_IELR;
+            else
+                usage_error = true;
+        }
+        else if (arg == "--no-cache")
+            use_cache = false;
+        else if (arg == "--artifacts")
+            options.artifacts = true;
+        else if (arg == "--dump-tokens")
+            options.dump_tokens = true;
+        else if (arg == "--ast")
+            options.ast = true;
+        else if (arg == "--jobs")
+        {
+            if (i + 1 >= argc || !parsePositiveInt(argv[++i], options.jobs))
+                usage_error = true;
+        }
+        else
+            files.push_back(arg);
+    }
+    if (files.size() != 2 || usage_error)
+    {
+        cerr << "Usage: " << argv[0] << " [--table lalr|ielr|clr] [--no-cache] [--jobs N]\n"
+             << "       " << string(strlen(argv[0]), ' ') << " [--artifacts] [--dump-tokens] [--ast] <input_file> <grammar_file>" << endl;
+        return 1;
+    }
+
+    try
+    {
+        Frontend frontend(files[1], mode, use_cache);
+        Compilation unit(files[0]);
+        frontend.compile(unit, options);
+        if (unit.valid)
+        {
+            cout << "Input is valid." << endl;
+            if (options.ast)
+            {
+                ofstream astFile(files[0] + ".ast");
+                unit.ast.print(astFile);
+                cerr << "AST: " << unit.ast.node_count << " nodes, " << unit.ast.arena.bytesUsed()
+                     << " bytes" << endl;
+            }
+        }
+        else
+        {
+            cout << "Input is invalid." << endl;
+            const Token &token = unit.error_token;
+            if (token.type == TOKEN_EOF)
+                cerr << "Syntax error: unexpected end of input at " << positionToString(token.pos) << endl;
+            else
+                cerr << "Syntax error: unexpected '" << token.lexeme << "' at " << positionToString(token.pos) << endl;
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
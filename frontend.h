@@ -0,0 +1,164 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+// Lexer, symbol table and parser in one process. Tokens go from the lexer
+// straight into Parser::push in the same pass that builds the symbol table;
+// nothing is written to disk unless the artifact files are asked for.
+
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+
+// TokenType -> grammar terminal ID, resolved by name once per grammar.
+// TOKEN_EOF is the end marker; types the grammar lacks (TOKEN_ERROR) map to
+// -1, which the parser rejects.
+class TerminalMap
+{
+    array<int, TOKEN_ERROR + 1> ids;
+
+public:
+    explicit TerminalMap(const Grammar &grammar)
+    {
+        for (int type = 0; type <= TOKEN_ERROR; type++)
+        {
+            TokenType t = static_cast<TokenType>(type);
+            ids[type] = t == TOKEN_EOF ? END_MARKER : grammar.terminal_id(tokenTypeToString(t));
+        }
+    }
+
+    int operator[](TokenType type) const { return ids[type]; }
+};
+
+// Token sink for buildSymbolTable that parses each token as it is emitted,
+// and passes it on to the lexer's output files when there are any. Remembers
+// the first token the parser rejected. Actions is NoActions or AstBuilder.
+template <typename Actions>
+class ParserSink
+{
+    Parser &parser;
+    const TerminalMap &terminals;
+    TokenOutput *files;
+    Actions &actions;
+
+public:
+    bool failed = false;
+    Token error_token;
+
+    ParserSink(Parser &parser, const TerminalMap &terminals, TokenOutput *files, Actions &actions)
+        : parser(parser), terminals(terminals), files(files), actions(actions) {}
+
+    void emit(const Token &token)
+    {
+        if (files)
+            files->emit(token);
+        if constexpr (!is_same<Actions, NoActions>::value)
+            actions.next = token;
+        if (!failed && parser.push(terminals[token.type], actions) == PARSE_ERROR)
+        {
+            failed = true;
+            error_token = token;
+        }
+    }
+};
+
+struct CompileOptions
+{
+    bool artifacts = false;   // Also write <file>.parse and <file>.symtab
+    bool dump_tokens = false; // And <file>.tokens
+    int jobs = 1;             // Lex on this many threads, then parse the token buffer
+    bool ast = false;         // Build the syntax tree into Compilation::ast
+};
+
+// Everything one compile produces. Lexemes in error_token and the symbol
+// table's names point into source and interner, so they live as long as this.
+struct Compilation
+{
+    string filename;
+    SourceBuffer source;
+    Interner interner;
+    SymbolTable symtab;
+    bool valid = false;
+    Token error_token; // First token the parser rejected; TOKEN_EOF if the input ended early
+    Ast ast;           // Only with CompileOptions::ast, and only for a valid input
+
+    explicit Compilation(const string &filename) : filename(filename), source(filename), symtab(interner) {}
+};
+
+// Grammar tables plus one reusable Parser; compile() can be called for any
+// number of files.
+class Frontend
+{
+public:
+    Grammar grammar;
+    CanonicalLR1 clr;
+    bool cached;
+    TerminalMap terminals;
+    Parser parser;
+
+    Frontend(const string &grammar_file, TableMode mode = TABLE_CLR, bool use_cache = true, int threads = 1)
+        : cached(load_tables(grammar_file, mode, use_cache, threads, grammar, clr)),
+          terminals(grammar), parser(clr) {}
+
+    // Lexes, builds the symbol table and parses unit.source in a single pass.
+    // Lexical errors throw, as in processFile.
+    void compile(Compilation &unit, const CompileOptions &options = CompileOptions())
+    {
+        if (!options.ast)
+        {
+            NoActions none;
+            compile(unit, options, none);
+            return;
+        }
+        if (!ast_rules)
+            ast_rules = make_unique<AstRules>(grammar);
+        AstBuilder builder(*ast_rules, unit.ast);
+        compile(unit, options, builder);
+        if (unit.valid)
+            builder.finish();
+    }
+
+private:
+    unique_ptr<AstRules> ast_rules; // Made on the first compile that asks for a tree
+
+    template <typename Actions>
+    void compile(Compilation &unit, const CompileOptions &options, Actions &actions)
+    {
+        unique_ptr<TokenOutput> files;
+        ofstream symtabFile;
+        if (options.artifacts || options.dump_tokens)
+        {
+            files = make_unique<TokenOutput>(unit.filename, unit.source.view(), options.dump_tokens);
+            symtabFile.open(unit.filename + ".symtab");
+            if (!files->is_open() || !symtabFile.is_open())
+                throw runtime_error("Error opening output files for " + unit.filename);
+        }
+
+        parser.begin();
+        ParserSink<Actions> sink(parser, terminals, files.get(), actions);
+        Position eof_pos;
+        if (options.jobs > 1)
+        {
+            vector<Token> tokens = lexParallel(unit.source.view(), options.jobs, unit.interner, &eof_pos);
+            TokenCursor cursor(tokens, eof_pos);
+            buildSymbolTable(cursor, unit.symtab, sink);
+        }
+        else
+        {
+            Lexer lexer(unit.source.view(), &unit.interner);
+            buildSymbolTable(lexer, unit.symtab, sink);
+            eof_pos = lexer.position();
+        }
+
+        unit.valid = !sink.failed && parser.push(END_MARKER, actions) == PARSE_ACCEPT;
+        if (!unit.valid)
+            unit.error_token = sink.failed ? sink.error_token : Token(TOKEN_EOF, "", eof_pos);
+
+        if (files)
+        {
+            unit.symtab.print(symtabFile);
+            files->close();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,1371 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+// Lexer, symbol table and the lexing drivers used by the lexer program, the
+// benchmark and any other front end that embeds them.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include "token_stream.h"
+
+using namespace std;
+
+// Character classes used to dispatch on the first byte of a token.
+enum CharClass : unsigned char
+{
+    CC_OTHER,
+    CC_SPACE,
+    CC_NEWLINE,
+    CC_IDENT,
+    CC_DIGIT,
+    CC_OPERATOR,
+    CC_REL_OPERATOR,
+    CC_PUNCTUATION
+};
+
+constexpr array<CharClass, 256> buildCharClassTable()
+{
+    array<CharClass, 256> table{};
+    for (int c = 0; c < 256; c++)
+        table[c] = CC_OTHER;
+    for (int c = 'a'; c <= 'z'; c++)
+        table[c] = CC_IDENT;
+    for (int c = 'A'; c <= 'Z'; c++)
+        table[c] = CC_IDENT;
+    table['_'] = CC_IDENT;
+    for (int c = '0'; c <= '9'; c++)
+        table[c] = CC_DIGIT;
+    // Same set as isspace() in the "C" locale
+    table[' '] = table['\t'] = table['\v'] = table['\f'] = table['\r'] = CC_SPACE;
+    table['\n'] = CC_NEWLINE;
+    table['+'] = table['-'] = table['*'] = table['/'] = table['%'] = CC_OPERATOR;
+    table['<'] = table['>'] = table['='] = CC_REL_OPERATOR;
+    table['{'] = table['}'] = table['('] = table[')'] = table[';'] = table[','] = CC_PUNCTUATION;
+    return table;
+}
+
+inline constexpr array<CharClass, 256> charClass = buildCharClassTable();
+
+inline CharClass classOf(char c)
+{
+    return charClass[static_cast<unsigned char>(c)];
+}
+
+inline bool isIdentChar(char c)
+{
+    CharClass cc = classOf(c);
+    return cc == CC_IDENT || cc == CC_DIGIT;
+}
+
+// Bulk scanners for the three loops that dominate on machine-generated input:
+// runs of whitespace, comment bodies and identifier characters. Each has a
+// scalar version and SSE2/AVX2 versions that test 16/32 bytes per step; the
+// widest one the CPU supports is picked once at startup.
+struct WhitespaceRun
+{
+    const char *stop;       // First byte that is not whitespace, or end
+    int newlines;           // Number of '\n' bytes skipped
+    const char *line_start; // Byte after the last '\n' skipped, or nullptr
+};
+
+inline WhitespaceRun skipWhitespaceScalar(const char *p, const char *end)
+{
+    WhitespaceRun run{p, 0, nullptr};
+    for (; p < end; p++)
+    {
+        CharClass cc = classOf(*p);
+        if (cc == CC_NEWLINE)
+        {
+            run.newlines++;
+            run.line_start = p + 1;
+        }
+        else if (cc != CC_SPACE)
+            break;
+    }
+    run.stop = p;
+    return run;
+}
+
+inline const char *findNewlineScalar(const char *p, const char *end)
+{
+    while (p < end && *p != '\n')
+        p++;
+    return p;
+}
+
+inline const char *skipIdentifierScalar(const char *p, const char *end)
+{
+    while (p < end && isIdentChar(*p))
+        p++;
+    return p;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define LEXER_HAVE_X86_SIMD 1
+
+// Bytes >= 0x80 compare as negative in the signed compares below, so they
+// never fall inside the ASCII ranges being tested.
+inline __m128i whitespaceMask128(__m128i v)
+{
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i control = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                    _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+    return _mm_or_si128(space, control);
+}
+
+inline __m128i identifierMask128(__m128i v)
+{
+    __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+}
+
+inline WhitespaceRun skipWhitespaceSSE2(const char *p, const char *end)
+{
+    WhitespaceRun run{p, 0, nullptr};
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned ws = _mm_movemask_epi8(whitespaceMask128(v));
+        unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        unsigned stop = ws == 0xFFFF ? 16 : __builtin_ctz(~ws);
+        nl &= (1u << stop) - 1;
+        if (nl)
+        {
+            run.newlines += __builtin_popcount(nl);
+            run.line_start = p + (31 - __builtin_clz(nl)) + 1;
+        }
+        p += stop;
+        if (stop < 16)
+        {
+            run.stop = p;
+            return run;
+        }
+    }
+    WhitespaceRun tail = skipWhitespaceScalar(p, end);
+    run.stop = tail.stop;
+    run.newlines += tail.newlines;
+    if (tail.line_start)
+        run.line_start = tail.line_start;
+    return run;
+}
+
+inline const char *findNewlineSSE2(const char *p, const char *end)
+{
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (nl)
+            return p + __builtin_ctz(nl);
+        p += 16;
+    }
+    return findNewlineScalar(p, end);
+}
+
+inline const char *skipIdentifierSSE2(const char *p, const char *end)
+{
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned id = _mm_movemask_epi8(identifierMask128(v));
+        if (id != 0xFFFF)
+            return p + __builtin_ctz(~id);
+        p += 16;
+    }
+    return skipIdentifierScalar(p, end);
+}
+
+__attribute__((target("avx2"))) inline __m256i whitespaceMask256(__m256i v)
+{
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+    return _mm256_or_si256(space, control);
+}
+
+__attribute__((target("avx2"))) inline __m256i identifierMask256(__m256i v)
+{
+    __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), folded));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+}
+
+__attribute__((target("avx2"))) inline WhitespaceRun skipWhitespaceAVX2(const char *p, const char *end)
+{
+    WhitespaceRun run{p, 0, nullptr};
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        uint32_t ws = _mm256_movemask_epi8(whitespaceMask256(v));
+        uint32_t nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        unsigned stop = ws == 0xFFFFFFFFu ? 32 : __builtin_ctz(~ws);
+        if (stop < 32)
+            nl &= (1u << stop) - 1;
+        if (nl)
+        {
+            run.newlines += __builtin_popcount(nl);
+            run.line_start = p + (31 - __builtin_clz(nl)) + 1;
+        }
+        p += stop;
+        if (stop < 32)
+        {
+            run.stop = p;
+            return run;
+        }
+    }
+    WhitespaceRun tail = skipWhitespaceSSE2(p, end);
+    run.stop = tail.stop;
+    run.newlines += tail.newlines;
+    if (tail.line_start)
+        run.line_start = tail.line_start;
+    return run;
+}
+
+__attribute__((target("avx2"))) inline const char *findNewlineAVX2(const char *p, const char *end)
+{
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        uint32_t nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if (nl)
+            return p + __builtin_ctz(nl);
+        p += 32;
+    }
+    return findNewlineSSE2(p, end);
+}
+
+__attribute__((target("avx2"))) inline const char *skipIdentifierAVX2(const char *p, const char *end)
+{
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        uint32_t id = _mm256_movemask_epi8(identifierMask256(v));
+        if (id != 0xFFFFFFFFu)
+            return p + __builtin_ctz(~id);
+        p += 32;
+    }
+    return skipIdentifierSSE2(p, end);
+}
+#endif
+
+struct ScanKernels
+{
+    WhitespaceRun (*skipWhitespace)(const char *, const char *);
+    const char *(*findNewline)(const char *, const char *);
+    const char *(*skipIdentifier)(const char *, const char *);
+    const char *name;
+};
+
+// LEXER_SIMD=scalar|sse2|avx2 in the environment overrides the choice.
+inline ScanKernels selectScanKernels()
+{
+    ScanKernels scalar{skipWhitespaceScalar, findNewlineScalar, skipIdentifierScalar, "scalar"};
+#ifdef LEXER_HAVE_X86_SIMD
+    ScanKernels sse2{skipWhitespaceSSE2, findNewlineSSE2, skipIdentifierSSE2, "sse2"};
+    ScanKernels avx2{skipWhitespaceAVX2, findNewlineAVX2, skipIdentifierAVX2, "avx2"};
+    const char *forced = getenv("LEXER_SIMD");
+    string choice = forced ? forced : "";
+    if (choice == "scalar")
+        return scalar;
+    if (choice == "sse2")
+        return sse2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return avx2;
+    // SSE2 is part of the x86-64 baseline; on 32-bit x86 check for it.
+    if (__builtin_cpu_supports("sse2"))
+        return sse2;
+#endif
+    return scalar;
+}
+
+inline const ScanKernels scanKernels = selectScanKernels();
+
+// Keyword recognition: switch on length, then on the first character, so an
+// identifier costs at most one memcmp against a single candidate keyword.
+inline TokenType keywordOrIdentifier(const char *s, size_t len)
+{
+    switch (len)
+    {
+    case 2:
+        if (s[0] == 'i' && s[1] == 'f')
+            return TOKEN_IF;
+        break;
+    case 3:
+        if (memcmp(s, "int", 3) == 0)
+            return TOKEN_INT;
+        break;
+    case 4:
+        switch (s[0])
+        {
+        case 'v':
+            if (memcmp(s, "void", 4) == 0)
+                return TOKEN_VOID;
+            break;
+        case 'e':
+            if (memcmp(s, "else", 4) == 0)
+                return TOKEN_ELSE;
+            break;
+        case 'r':
+            if (memcmp(s, "read", 4) == 0)
+                return TOKEN_READ;
+            break;
+        }
+        break;
+    case 5:
+        switch (s[0])
+        {
+        case 'f':
+            if (memcmp(s, "float", 5) == 0)
+                return TOKEN_FLOAT;
+            break;
+        case 'p':
+            if (memcmp(s, "print", 5) == 0)
+                return TOKEN_PRINT;
+            break;
+        }
+        break;
+    case 6:
+        if (memcmp(s, "return", 6) == 0)
+            return TOKEN_RETURN;
+        break;
+    }
+    return TOKEN_ID;
+}
+
+const uint32_t NO_SYMBOL = 0xFFFFFFFF;
+
+// Maps every distinct identifier to a dense integer ID, assigned in order of
+// first appearance. Names are copied into block storage owned by the
+// interner, so IDs stay resolvable after the source buffer is gone.
+class Interner
+{
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t id;
+    };
+    vector<string_view> names;
+    vector<Slot> slots; // Open addressing, linear probing, power-of-two size
+    vector<unique_ptr<char[]>> blocks;
+    vector<unique_ptr<char[]>> oversized; // Names longer than a block
+    size_t block_used = 0;
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+public:
+    Interner() : slots(1024, Slot{0, NO_SYMBOL}) {}
+
+    uint32_t intern(string_view name)
+    {
+        uint32_t hash = static_cast<uint32_t>(std::hash<string_view>()(name));
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            Slot &slot = slots[i];
+            if (slot.id == NO_SYMBOL)
+            {
+                slot = {hash, static_cast<uint32_t>(names.size())};
+                names.push_back(store(name));
+                if (names.size() * 2 > slots.size())
+                    grow();
+                return names.size() - 1;
+            }
+            if (slot.hash == hash && names[slot.id] == name)
+                return slot.id;
+        }
+    }
+
+    string_view name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+private:
+    string_view store(string_view name)
+    {
+        if (name.size() > BLOCK_SIZE)
+        {
+            oversized.emplace_back(new char[name.size()]);
+            memcpy(oversized.back().get(), name.data(), name.size());
+            return string_view(oversized.back().get(), name.size());
+        }
+        if (blocks.empty() || block_used + name.size() > BLOCK_SIZE)
+        {
+            blocks.emplace_back(new char[BLOCK_SIZE]);
+            block_used = 0;
+        }
+        char *dest = blocks.back().get() + block_used;
+        memcpy(dest, name.data(), name.size());
+        block_used += name.size();
+        return string_view(dest, name.size());
+    }
+
+    void grow()
+    {
+        vector<Slot> old(slots.size() * 2, Slot{0, NO_SYMBOL});
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (const Slot &slot : old)
+        {
+            if (slot.id == NO_SYMBOL)
+                continue;
+            size_t i = slot.hash & mask;
+            while (slots[i].id != NO_SYMBOL)
+                i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+};
+
+struct Token
+{
+    TokenType type;
+    uint32_t symbol = NO_SYMBOL; // Interned ID, set for TOKEN_ID
+    string_view lexeme;          // Slice of the source buffer, never owned
+    Position pos;
+    Token(TokenType t, string_view l, Position p) : type(t), lexeme(l), pos(p) {}
+    Token() {}
+};
+
+// Destination for every token the lexer produces: the binary token stream
+// read by the parser and, optionally, the human-readable .tokens dump.
+class TokenOutput
+{
+    TokenStreamWriter parseFile;
+    ofstream tokenFile;
+    bool dumpTokens;
+    string_view source;          // Lexemes are slices of this
+    uint64_t source_offset = 0;  // File offset of source.data()
+
+public:
+    TokenOutput(const string &filename, string_view source, bool dumpTokens)
+        : parseFile(filename + ".parse", source.size()), dumpTokens(dumpTokens), source(source)
+    {
+        if (dumpTokens)
+            tokenFile.open(filename + ".tokens");
+    }
+
+    bool is_open() const { return parseFile.is_open() && (!dumpTokens || tokenFile.is_open()); }
+
+    // Used when the input arrives in blocks: lexemes now point into window,
+    // which starts at byte offset of the input.
+    void setWindow(string_view window, uint64_t offset)
+    {
+        source = window;
+        source_offset = offset;
+        parseFile.setSourceSize(offset + window.size());
+    }
+
+    void emit(const Token &token)
+    {
+        parseFile.write(token.type, source_offset + (token.lexeme.data() - source.data()), token.lexeme.size(), token.pos);
+        if (dumpTokens)
+        {
+            tokenFile << setw(10) << left << "[" + positionToString(token.pos) + "]"
+                      << setw(15) << left << tokenTypeToString(token.type)
+                      << setw(20) << left << token.lexeme << "\n";
+        }
+    }
+
+    void close()
+    {
+        parseFile.close();
+        if (dumpTokens)
+            tokenFile.close();
+    }
+};
+
+class Lexer
+{
+    string_view input;
+    size_t pos;
+    Position current_pos;
+    Interner *interner; // Identifiers get no symbol ID when null
+
+public:
+    Lexer(string_view input, Interner *interner = nullptr)
+        : input(input), pos(0), current_pos(1, 1), interner(interner) {}
+
+    // Output is any sink with emit(const Token &): a TokenOutput, or a parser
+    // consuming the tokens directly (see frontend.h).
+    template <typename Output>
+    Token getNextToken(Output &out)
+    {
+        Token token = getNextToken();
+        if (token.type != TOKEN_EOF)
+            out.emit(token);
+        return token;
+    }
+
+    Position position() const { return current_pos; }
+
+    // Continues lexing in a new buffer, keeping the line/column position.
+    void resume(string_view next_input)
+    {
+        input = next_input;
+        pos = 0;
+    }
+
+    Token getNextToken()
+    {
+        skipWhitespaceAndComments();
+        if (pos >= input.size())
+            return Token(TOKEN_EOF, "", current_pos);
+
+        Position start_pos = current_pos;
+        char current = input[pos];
+        Token token;
+        switch (classOf(current))
+        {
+        case CC_IDENT:
+            token = readIdentifier(start_pos);
+            break;
+        case CC_DIGIT:
+            token = readNumber(start_pos);
+            break;
+        case CC_OPERATOR:
+            token = readOperator(start_pos);
+            break;
+        case CC_REL_OPERATOR:
+            token = readRelOperator(start_pos);
+            break;
+        case CC_PUNCTUATION:
+            token = readPunctuation(start_pos);
+            break;
+        default:
+            pos++;
+            current_pos.column++;
+            token = Token(TOKEN_ERROR, input.substr(pos - 1, 1), start_pos);
+            break;
+        }
+        return token;
+    }
+
+private:
+    void skipWhitespaceAndComments()
+    {
+        const char *base = input.data();
+        const char *end = base + input.size();
+        while (pos < input.size())
+        {
+            WhitespaceRun run = scanKernels.skipWhitespace(base + pos, end);
+            if (run.newlines)
+            {
+                current_pos.line += run.newlines;
+                current_pos.column = 1 + (run.stop - run.line_start);
+            }
+            else
+            {
+                current_pos.column += run.stop - (base + pos);
+            }
+            pos = run.stop - base;
+
+            if (pos + 1 < input.size() && input[pos] == '/' && input[pos + 1] == '/')
+                pos = scanKernels.findNewline(base + pos + 2, end) - base;
+            else
+                break;
+        }
+    }
+
+    Token readIdentifier(Position start_pos)
+    {
+        size_t start = pos;
+        pos = scanKernels.skipIdentifier(input.data() + pos, input.data() + input.size()) - input.data();
+        current_pos.column += pos - start;
+        string_view lexeme = input.substr(start, pos - start);
+        Token token(keywordOrIdentifier(lexeme.data(), lexeme.size()), lexeme, start_pos);
+        if (token.type == TOKEN_ID && interner)
+            token.symbol = interner->intern(lexeme);
+        return token;
+    }
+
+    Token readNumber(Position start_pos)
+    {
+        size_t start = pos;
+        bool isFloat = false;
+        while (pos < input.size() && classOf(input[pos]) == CC_DIGIT)
+        {
+            pos++;
+            current_pos.column++;
+        }
+        if (pos < input.size() && input[pos] == '.')
+        {
+            isFloat = true;
+            pos++;
+            current_pos.column++;
+            while (pos < input.size() && classOf(input[pos]) == CC_DIGIT)
+            {
+                pos++;
+                current_pos.column++;
+            }
+        }
+        return Token(isFloat ? TOKEN_FLOAT_LIT : TOKEN_INT_LIT, input.substr(start, pos - start), start_pos);
+    }
+
+    Token readOperator(Position start_pos)
+    {
+        char c = input[pos++];
+        current_pos.column++;
+
+        if (c == '+' && pos < input.size() && input[pos] == '+')
+        {
+            pos++;
+            current_pos.column++;
+            return Token(TOKEN_INCREMENT, input.substr(pos - 2, 2), start_pos);
+        }
+
+        TokenType type = TOKEN_ERROR;
+        switch (c)
+        {
+        case '+':
+            type = TOKEN_PLUS;
+            break;
+        case '-':
+            type = TOKEN_MINUS;
+            break;
+        case '*':
+            type = TOKEN_MULTIPLY;
+            break;
+        case '/':
+            type = TOKEN_DIVIDE;
+            break;
+        case '%':
+            type = TOKEN_MOD;
+            break;
+        }
+        return Token(type, input.substr(pos - 1, 1), start_pos);
+    }
+
+    Token readRelOperator(Position start_pos)
+    {
+        char c = input[pos++];
+        current_pos.column++;
+
+        if (c == '=' && pos < input.size() && input[pos] == '=')
+        {
+            pos++;
+            current_pos.column++;
+            return Token(TOKEN_EQ, input.substr(pos - 2, 2), start_pos);
+        }
+
+        TokenType type = TOKEN_ERROR;
+        switch (c)
+        {
+        case '<':
+            type = TOKEN_LT;
+            break;
+        case '>':
+            type = TOKEN_GT;
+            break;
+        case '=':
+            type = TOKEN_EQUALS;
+            break;
+        }
+        return Token(type, input.substr(pos - 1, 1), start_pos);
+    }
+
+    Token readPunctuation(Position start_pos)
+    {
+        char c = input[pos++];
+        current_pos.column++;
+
+        TokenType type = TOKEN_ERROR;
+        switch (c)
+        {
+        case '{':
+            type = TOKEN_LBRACE;
+            break;
+        case '}':
+            type = TOKEN_RBRACE;
+            break;
+        case '(':
+            type = TOKEN_LPAREN;
+            break;
+        case ')':
+            type = TOKEN_RPAREN;
+            break;
+        case ';':
+            type = TOKEN_SEMICOLON;
+            break;
+        case ',':
+            type = TOKEN_COMMA;
+            break;
+        }
+        return Token(type, input.substr(pos - 1, 1), start_pos);
+    }
+};
+
+// Reads an input stream in fixed-size blocks and hands it out as windows
+// that end on a line boundary. Tokens and comments never span a newline, so
+// a window can always be lexed to its end; the partial line after the last
+// newline is carried over to the front of the next window. Memory stays at
+// one block plus the longest line, however long the input is.
+class StreamReader
+{
+    istream &in;
+    vector<char> buffer;
+    size_t filled = 0;      // Bytes in buffer
+    size_t window_end = 0;  // End of the window handed out last
+    uint64_t offset = 0;    // Input offset of buffer[0]
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+public:
+    explicit StreamReader(istream &in) : in(in), buffer(BLOCK_SIZE) {}
+
+    // Returns false once the input is exhausted.
+    bool next(string_view &window, uint64_t &window_offset)
+    {
+        // Carry the unfinished line over to the front.
+        memmove(buffer.data(), buffer.data() + window_end, filled - window_end);
+        offset += window_end;
+        filled -= window_end;
+        window_end = 0;
+
+        size_t scanned = 0;
+        while (true)
+        {
+            size_t nl = string_view(buffer.data() + scanned, filled - scanned).rfind('\n');
+            if (nl != string_view::npos)
+            {
+                window_end = scanned + nl + 1;
+                break;
+            }
+            scanned = filled;
+            if (!in)
+            {
+                window_end = filled;
+                break;
+            }
+            if (filled == buffer.size())
+                buffer.resize(buffer.size() * 2); // Line longer than the buffer
+            in.read(buffer.data() + filled, buffer.size() - filled);
+            filled += in.gcount();
+        }
+        if (window_end == 0)
+            return false;
+        window = string_view(buffer.data(), window_end);
+        window_offset = offset;
+        return true;
+    }
+};
+
+// Lexer over a StreamReader: lexes one window at a time and refills when a
+// window is used up. Lexemes are only valid until the next refill.
+class StreamingLexer
+{
+    StreamReader reader;
+    Lexer lexer;
+    TokenOutput &out;
+
+public:
+    StreamingLexer(istream &in, Interner *interner, TokenOutput &out)
+        : reader(in), lexer(string_view(), interner), out(out) {}
+
+    // Next token, already emitted to the TokenOutput given at construction.
+    Token getNextToken()
+    {
+        Token token = lexer.getNextToken(out);
+        while (token.type == TOKEN_EOF && refill())
+            token = lexer.getNextToken(out);
+        return token;
+    }
+
+private:
+    bool refill()
+    {
+        string_view window;
+        uint64_t offset;
+        if (!reader.next(window, offset))
+            return false;
+        lexer.resume(window);
+        out.setWindow(window, offset);
+        return true;
+    }
+};
+
+// Lexes a buffer on several threads. The token grammar has no multi-line
+// constructs, so the buffer is cut just after newlines and every chunk is
+// lexed independently; line numbers are shifted afterwards by the number of
+// lines in the preceding chunks. Columns need no fix-up because every chunk
+// starts at the beginning of a line. Each chunk interns into its own table;
+// the local IDs are then remapped chunk by chunk, which hands out the same
+// first-appearance IDs a sequential run would. end_pos, if given, receives
+// the position after the last token, as Lexer::position() would report it.
+inline vector<Token> lexParallel(string_view input, int jobs, Interner &interner, Position *end_pos = nullptr)
+{
+    vector<string_view> chunks;
+    size_t start = 0;
+    for (int i = 1; i <= jobs && start < input.size(); i++)
+    {
+        size_t cut = input.size() * i / jobs;
+        if (cut <= start)
+            continue;
+        if (i < jobs)
+        {
+            cut = input.find('\n', cut - 1);
+            cut = cut == string_view::npos ? input.size() : cut + 1;
+        }
+        chunks.push_back(input.substr(start, cut - start));
+        start = cut;
+    }
+
+    vector<vector<Token>> chunkTokens(chunks.size());
+    vector<Position> chunkEnds(chunks.size());
+    vector<Interner> chunkInterners(chunks.size());
+    vector<thread> workers;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        workers.emplace_back([&, i]
+                             {
+            Lexer lexer(chunks[i], &chunkInterners[i]);
+            for (Token token = lexer.getNextToken(); token.type != TOKEN_EOF; token = lexer.getNextToken())
+                chunkTokens[i].push_back(token);
+            chunkEnds[i] = lexer.position(); });
+    }
+    for (auto &worker : workers)
+        worker.join();
+
+    size_t total = 0;
+    for (auto &tokens : chunkTokens)
+        total += tokens.size();
+    vector<Token> merged;
+    merged.reserve(total);
+    int lineOffset = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        vector<uint32_t> remap(chunkInterners[i].size());
+        for (uint32_t id = 0; id < remap.size(); id++)
+            remap[id] = interner.intern(chunkInterners[i].name(id));
+        for (Token &token : chunkTokens[i])
+        {
+            token.pos.line += lineOffset;
+            if (token.symbol != NO_SYMBOL)
+                token.symbol = remap[token.symbol];
+            merged.push_back(token);
+        }
+        if (end_pos && i + 1 == chunks.size())
+            *end_pos = Position(chunkEnds[i].line + lineOffset, chunkEnds[i].column);
+        lineOffset += chunkEnds[i].line - 1;
+        vector<Token>().swap(chunkTokens[i]);
+    }
+    return merged;
+}
+
+// Replays an already lexed token vector through the same interface as Lexer,
+// emitting each token as it is consumed.
+class TokenCursor
+{
+    const vector<Token> &tokens;
+    size_t next = 0;
+    Position eof_pos;
+
+public:
+    TokenCursor(const vector<Token> &tokens, Position eof_pos) : tokens(tokens), eof_pos(eof_pos) {}
+
+    template <typename Output>
+    Token getNextToken(Output &out)
+    {
+        if (next == tokens.size())
+            return Token(TOKEN_EOF, "", eof_pos);
+        const Token &token = tokens[next++];
+        out.emit(token);
+        return token;
+    }
+};
+
+// Bump allocator for everything the symbol table creates during one
+// compilation. Objects are never destroyed individually; the blocks are
+// released together when the arena goes away.
+class Arena
+{
+    vector<unique_ptr<char[]>> blocks;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    size_t used = 0;
+    static constexpr size_t BLOCK_SIZE = 256 * 1024;
+
+public:
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+    }
+
+    template <typename T>
+    T *makeArray(size_t count)
+    {
+        static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        T *array = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++)
+            new (array + i) T();
+        return array;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return blocks.size() * BLOCK_SIZE; }
+
+private:
+    void *allocate(size_t size, size_t align)
+    {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (!cursor || p + size > reinterpret_cast<uintptr_t>(limit))
+        {
+            size_t block = max(BLOCK_SIZE, size + align);
+            blocks.emplace_back(new char[block]);
+            cursor = blocks.back().get();
+            limit = cursor + block;
+            p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cursor = reinterpret_cast<char *>(p + size);
+        used += size;
+        return reinterpret_cast<void *>(p);
+    }
+};
+
+enum class TypeKind : uint8_t
+{
+    Int,
+    Float,
+    Void
+};
+
+inline TypeKind typeFromToken(TokenType type)
+{
+    return type == TOKEN_FLOAT ? TypeKind::Float : type == TOKEN_VOID ? TypeKind::Void
+                                                                      : TypeKind::Int;
+}
+
+inline const char *typeName(TypeKind type)
+{
+    switch (type)
+    {
+    case TypeKind::Int:
+        return "int";
+    case TypeKind::Float:
+        return "float";
+    default:
+        return "void";
+    }
+}
+
+struct Parameter
+{
+    TypeKind type;
+    uint32_t name; // Interned symbol ID
+    Position pos;
+};
+
+// Function data lives out of line so that variable entries, the vast
+// majority, do not carry it.
+struct FunctionInfo
+{
+    TypeKind return_type;
+    uint32_t param_count;
+    const Parameter *params; // Arena array
+    Position decl_pos;
+};
+
+const uint32_t NO_FUNCTION = 0xFFFFFFFF;
+
+struct SymbolEntry
+{
+    enum class Kind : uint8_t
+    {
+        Variable,
+        Function
+    };
+    Kind kind;
+    TypeKind var_type;  // For variables
+    uint32_t function;  // Index into SymbolTable's functions, or NO_FUNCTION
+    Position decl_pos;
+};
+
+// Flat symbol table in the LeBlanc-Cook style: every symbol ID maps directly
+// to its innermost visible binding, and each binding links to the one it
+// shadows. Entering a scope records a mark in the undo log, leaving it pops
+// the bindings made since the mark, so lookup is a single array probe no
+// matter how deeply scopes are nested. Scopes, bindings and function data are
+// allocated from an arena and never freed individually, which keeps every
+// scope's declarations available for print().
+class SymbolTable
+{
+    struct Binding
+    {
+        SymbolEntry entry;
+        uint32_t name;
+        uint32_t scope;        // Index into scopes
+        Binding *shadowed;     // Binding hidden by this one
+        Binding *next_in_scope; // Declaration order within the scope
+    };
+
+    struct ScopeRecord
+    {
+        Position start;
+        Binding *first;
+        Binding *last;
+    };
+
+    Arena arena;
+    vector<Binding *> visible;                  // Symbol ID -> innermost binding
+    vector<uint32_t> undo_log;                  // Symbols bound in the open scopes
+    vector<pair<uint32_t, size_t>> open_scopes; // (scope, undo_log size on entry)
+    vector<ScopeRecord *> scopes;               // In order of creation; 0 is global
+    vector<const FunctionInfo *> functions;
+    size_t symbol_count = 0;
+    const Interner &names;
+
+public:
+    SymbolTable(const Interner &names) : names(names)
+    {
+        scopes.push_back(arena.make<ScopeRecord>(Position(), nullptr, nullptr));
+        open_scopes.push_back({0, 0});
+    }
+
+    void enterScope(Position pos)
+    {
+        open_scopes.push_back({static_cast<uint32_t>(scopes.size()), undo_log.size()});
+        scopes.push_back(arena.make<ScopeRecord>(pos, nullptr, nullptr));
+    }
+
+    void exitScope()
+    {
+        if (open_scopes.size() == 1)
+            return;
+        size_t mark = open_scopes.back().second;
+        while (undo_log.size() > mark)
+        {
+            uint32_t name = undo_log.back();
+            undo_log.pop_back();
+            visible[name] = visible[name]->shadowed;
+        }
+        open_scopes.pop_back();
+    }
+
+    bool insertVariable(uint32_t name, TypeKind type, Position pos)
+    {
+        uint32_t scope = open_scopes.back().first;
+        Binding *top = visibleBinding(name);
+        if (top && top->scope == scope)
+            return false;
+        Binding *binding = bind(name, scope, {SymbolEntry::Kind::Variable, type, NO_FUNCTION, pos});
+        binding->shadowed = top;
+        visible[name] = binding;
+        if (scope != 0)
+            undo_log.push_back(name);
+        return true;
+    }
+
+    bool insertFunction(uint32_t name, TypeKind return_type, const vector<Parameter> &params, Position pos)
+    {
+        // Functions always go to the global scope, i.e. to the bottom of the
+        // name's binding chain, underneath any inner bindings.
+        Binding *below = nullptr;
+        Binding *bottom = visibleBinding(name);
+        while (bottom && bottom->scope != 0)
+        {
+            below = bottom;
+            bottom = bottom->shadowed;
+        }
+        if (bottom)
+            return false;
+
+        Parameter *stored = arena.makeArray<Parameter>(params.size());
+        copy(params.begin(), params.end(), stored);
+        functions.push_back(arena.make<FunctionInfo>(return_type, static_cast<uint32_t>(params.size()), stored, pos));
+        Binding *binding = bind(name, 0, {SymbolEntry::Kind::Function, TypeKind::Void, static_cast<uint32_t>(functions.size() - 1), pos});
+        if (below)
+            below->shadowed = binding;
+        else
+            visible[name] = binding;
+        return true;
+    }
+
+    SymbolEntry *lookup(uint32_t name)
+    {
+        Binding *top = visibleBinding(name);
+        return top ? &top->entry : nullptr;
+    }
+
+    string_view nameOf(uint32_t symbol) const { return names.name(symbol); }
+
+    size_t symbolCount() const { return symbol_count; }
+
+    // Memory held by the table itself: arena contents plus the index vectors.
+    size_t bytesUsed() const
+    {
+        return arena.bytesUsed() + visible.capacity() * sizeof(Binding *) +
+               scopes.capacity() * sizeof(ScopeRecord *) + functions.capacity() * sizeof(FunctionInfo *);
+    }
+
+    // As bytesUsed, but counting whole arena blocks.
+    size_t bytesReserved() const
+    {
+        return bytesUsed() - arena.bytesUsed() + arena.bytesReserved();
+    }
+
+    void print(ofstream &outFile)
+    {
+        outFile << "Symbol Table Hierarchy:\n";
+        for (const ScopeRecord *scope : scopes)
+        {
+            outFile << "Scope started at " << positionToString(scope->start) << "\n";
+
+            // Print functions first
+            for (const Binding *b = scope->first; b; b = b->next_in_scope)
+            {
+                if (b->entry.kind == SymbolEntry::Kind::Function)
+                {
+                    const FunctionInfo &func = *functions[b->entry.function];
+                    outFile << "  ◉ Function: " << names.name(b->name) << " → " << typeName(func.return_type)
+                            << " (declared at " << positionToString(b->entry.decl_pos) << ")\n";
+                    for (uint32_t i = 0; i < func.param_count; i++)
+                    {
+                        outFile << "    ⤷ Parameter: " << names.name(func.params[i].name) << " : " << typeName(func.params[i].type) << "\n";
+                    }
+                }
+            }
+
+            // Print variables
+            for (const Binding *b = scope->first; b; b = b->next_in_scope)
+            {
+                if (b->entry.kind == SymbolEntry::Kind::Variable)
+                {
+                    outFile << "  ■ Variable: " << names.name(b->name) << " : " << typeName(b->entry.var_type)
+                            << " (declared at " << positionToString(b->entry.decl_pos) << ")\n";
+                }
+            }
+            outFile << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
+        }
+    }
+
+private:
+    Binding *visibleBinding(uint32_t name)
+    {
+        if (name >= visible.size())
+            visible.resize(max<size_t>(name + 1, visible.size() * 2), nullptr);
+        return visible[name];
+    }
+
+    Binding *bind(uint32_t name, uint32_t scope, SymbolEntry entry)
+    {
+        Binding *binding = arena.make<Binding>(entry, name, scope, nullptr, nullptr);
+        ScopeRecord *record = scopes[scope];
+        if (record->last)
+            record->last->next_in_scope = binding;
+        else
+            record->first = binding;
+        record->last = binding;
+        symbol_count++;
+        return binding;
+    }
+};
+
+// Next token from a token source, emitted to out. A StreamingLexer is bound
+// to its TokenOutput and emits by itself.
+template <typename TokenSource, typename Output>
+Token nextToken(TokenSource &source, Output &out)
+{
+    return source.getNextToken(out);
+}
+
+inline Token nextToken(StreamingLexer &source, TokenOutput &)
+{
+    return source.getNextToken();
+}
+
+template <typename TokenSource, typename Output>
+void processFunctionDecl(TokenSource &lexer, SymbolTable &symtab, TypeKind return_type, const Token &id_token, Output &out)
+{
+    vector<Parameter> params;
+    Token token = nextToken(lexer, out);
+
+    // Parse parameters
+    while (token.type != TOKEN_RPAREN && token.type != TOKEN_EOF)
+    {
+        if (token.type == TOKEN_INT || token.type == TOKEN_FLOAT)
+        {
+            TypeKind type = typeFromToken(token.type);
+            Token name = nextToken(lexer, out);
+            if (name.type == TOKEN_ID)
+            {
+                params.push_back({type, name.symbol, name.pos});
+                Token comma = nextToken(lexer, out);
+                if (comma.type != TOKEN_COMMA)
+                    break;
+                token = nextToken(lexer, out);
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    // Insert function into global scope
+    if (!symtab.insertFunction(id_token.symbol, return_type, params, id_token.pos))
+    {
+        cerr << "Error: Function " << symtab.nameOf(id_token.symbol) << " already declared at "
+             << id_token.pos.line << ":" << id_token.pos.column << endl;
+    }
+
+    // Enter function scope
+    Token lbrace = nextToken(lexer, out);
+    if (lbrace.type == TOKEN_LBRACE)
+    {
+        symtab.enterScope(lbrace.pos);
+        // Insert parameters into function scope
+        for (const Parameter &param : params)
+        {
+            if (!symtab.insertVariable(param.name, param.type, param.pos))
+            {
+                cerr << "Error: Parameter " << symtab.nameOf(param.name) << " already declared\n";
+            }
+        }
+    }
+}
+
+template <typename TokenSource, typename Output>
+void buildSymbolTable(TokenSource &lexer, SymbolTable &symtab, Output &out)
+{
+    Token token = nextToken(lexer, out);
+
+    while (token.type != TOKEN_EOF && token.type != TOKEN_ERROR)
+    {
+        if (token.type == TOKEN_LBRACE)
+        {
+            symtab.enterScope(token.pos);
+        }
+        else if (token.type == TOKEN_RBRACE)
+        {
+            symtab.exitScope();
+        }
+        else if (token.type == TOKEN_INT || token.type == TOKEN_FLOAT || token.type == TOKEN_VOID)
+        {
+            TypeKind return_type = typeFromToken(token.type);
+            Token id_token = nextToken(lexer, out);
+            if (id_token.type == TOKEN_ID)
+            {
+                Token next = nextToken(lexer, out);
+                if (next.type == TOKEN_LPAREN)
+                {
+                    processFunctionDecl(lexer, symtab, return_type, id_token, out);
+                }
+                else
+                {
+                    // Variable declaration
+                    if (!symtab.insertVariable(id_token.symbol, return_type, id_token.pos))
+                    {
+                        cerr << "Error: " << symtab.nameOf(id_token.symbol) << " already declared at "
+                             << id_token.pos.line << ":" << id_token.pos.column << endl;
+                    }
+                }
+            }
+        }
+        else if (token.type == TOKEN_ID)
+        {
+            if (!symtab.lookup(token.symbol))
+            {
+                cerr << "Error: Undeclared identifier '" << token.lexeme
+                     << "' at " << token.pos.line << ":" << token.pos.column << endl;
+            }
+        }
+        token = nextToken(lexer, out);
+    }
+    if (token.type == TOKEN_ERROR)
+    {
+        throw runtime_error("Unexpected token '" + string(token.lexeme) + "' at " + positionToString(token.pos));
+    }
+}
+
+// Parses a command-line count such as --jobs N. Fails unless the whole
+// argument is a positive integer.
+inline bool parsePositiveInt(const char *text, int &value)
+{
+    char *end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || parsed < 1 || parsed > INT_MAX)
+        return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// Lexes standard input as it arrives; outputs go to stdin.parse etc.
+inline void processStream(istream &in, bool dumpTokens)
+{
+    const string filename = "stdin";
+    ofstream symtabFile(filename + ".symtab");
+    TokenOutput out(filename, string_view(), dumpTokens);
+    if (!symtabFile.is_open() || !out.is_open())
+    {
+        cerr << "Error opening output files!\n";
+        return;
+    }
+
+    Interner interner;
+    SymbolTable symtab(interner);
+    StreamingLexer lexer(in, &interner, out);
+    buildSymbolTable(lexer, symtab, out);
+    symtab.print(symtabFile);
+    symtabFile.close();
+    out.close();
+}
+
+inline void processFile(const string &filename, bool dumpTokens, int jobs)
+{
+    SourceBuffer source(filename);
+
+    ofstream symtabFile(filename + ".symtab");
+    TokenOutput out(filename, source.view(), dumpTokens);
+    if (!symtabFile.is_open() || !out.is_open())
+    {
+        cerr << "Error opening output files!\n";
+        return;
+    }
+
+    Interner interner;
+    SymbolTable symtab(interner);
+    if (jobs > 1)
+    {
+        Position end_pos;
+        vector<Token> tokens = lexParallel(source.view(), jobs, interner, &end_pos);
+        TokenCursor cursor(tokens, end_pos);
+        buildSymbolTable(cursor, symtab, out);
+    }
+    else
+    {
+        Lexer lexer(source.view(), &interner);
+        buildSymbolTable(lexer, symtab, out);
+    }
+    symtab.print(symtabFile);
+    symtabFile.close();
+    out.close();
+}
+
+#endif
@@ -0,0 +1,400 @@
+// Lexer throughput benchmark. Generates a synthetic program from the
+// constructs the language supports and measures Lexer::getNextToken and
+// processFile over it.
+//
+//   g++ -O2 -pthread lexer_bench.cpp -o lexer_bench
+//   ./lexer_bench --functions 20000 --depth 4 --json
+
+#include "lexer.h"
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <cstdio>
+#include <atomic>
+
+// Counts heap allocations so the benchmark can report allocations per token.
+// Atomic because the --jobs lexing threads allocate too.
+static atomic<size_t> allocation_count{0};
+
+void *operator new(size_t size)
+{
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+struct GeneratorOptions
+{
+    int functions = 2000;
+    int globals = 20;
+    int statements = 8; // Statements per block
+    int depth = 3;      // Maximum if/else nesting
+    int max_params = 3;
+    int comment_percent = 10;
+    unsigned seed = 1;
+};
+
+// Produces a syntactically valid program in which every identifier is
+// declared before use, so processFile runs without diagnostics.
+class ProgramGenerator
+{
+    const GeneratorOptions &opt;
+    mt19937 rng;
+    ostringstream out;
+    vector<pair<string, int>> functions; // (name, parameter count)
+    vector<vector<string>> scopes;       // Visible variables per open scope
+    int next_var = 0;
+
+public:
+    explicit ProgramGenerator(const GeneratorOptions &opt) : opt(opt), rng(opt.seed) {}
+
+    string generate()
+    {
+        scopes.push_back({});
+        for (int i = 0; i < opt.globals; i++)
+            declaration(0);
+        for (int i = 0; i < opt.functions; i++)
+            function(i);
+        return out.str();
+    }
+
+private:
+    int pick(int n) { return uniform_int_distribution<int>(0, n - 1)(rng); }
+    bool chance(int percent) { return pick(100) < percent; }
+
+    void indent(int level) { out << string(level * 4, ' '); }
+
+    string type() { return chance(70) ? "int" : "float"; }
+
+    string variable()
+    {
+        size_t total = 0;
+        for (auto &scope : scopes)
+            total += scope.size();
+        size_t index = pick(total);
+        for (auto &scope : scopes)
+        {
+            if (index < scope.size())
+                return scope[index];
+            index -= scope.size();
+        }
+        return scopes[0][0];
+    }
+
+    string literal()
+    {
+        if (chance(80))
+            return to_string(pick(1000));
+        return to_string(pick(100)) + "." + to_string(pick(100));
+    }
+
+    string operand(int depth)
+    {
+        int choice = pick(10);
+        if (choice < 5)
+            return variable();
+        if (choice < 8)
+            return literal();
+        if (choice < 9 && depth < 2)
+            return "(" + expression(depth + 1) + ")";
+        if (!functions.empty() && depth < 2)
+        {
+            auto &[name, params] = functions[pick(functions.size())];
+            string call = name + "(";
+            for (int i = 0; i < params; i++)
+                call += (i ? ", " : "") + expression(depth + 1);
+            return call + ")";
+        }
+        return variable();
+    }
+
+    string expression(int depth = 0)
+    {
+        static const char *ops[] = {" + ", " - ", " * ", " / ", " % "};
+        string expr = operand(depth);
+        int terms = pick(4);
+        for (int i = 0; i < terms; i++)
+            expr += ops[pick(5)] + operand(depth);
+        return expr;
+    }
+
+    void comment(int level)
+    {
+        if (!chance(opt.comment_percent))
+            return;
+        indent(level);
+        out << "// generated comment " << pick(100000) << ": the quick brown fox jumps over the lazy dog\n";
+    }
+
+    void declaration(int level)
+    {
+        string name = "v" + to_string(next_var++);
+        indent(level);
+        out << type() << " " << name;
+        if (level == 0 || chance(60))
+            out << " = " << (scopes.size() == 1 && scopes[0].empty() ? literal() : expression());
+        out << ";\n";
+        scopes.back().push_back(name);
+    }
+
+    void statement(int level, int depth)
+    {
+        comment(level);
+        int choice = pick(depth < opt.depth ? 8 : 7);
+        switch (choice)
+        {
+        case 0:
+        case 1:
+            declaration(level);
+            break;
+        case 2:
+        case 3:
+            indent(level);
+            out << variable() << " = " << expression() << ";\n";
+            break;
+        case 4:
+            indent(level);
+            out << (chance(50) ? "read " : "print ") << variable() << ";\n";
+            break;
+        case 5:
+            indent(level);
+            out << variable() << "++;\n";
+            break;
+        case 6:
+            indent(level);
+            out << expression() << ";\n";
+            break;
+        default:
+        {
+            static const char *relops[] = {" < ", " > ", " == "};
+            indent(level);
+            out << "if (" << expression() << relops[pick(3)] << expression() << ")\n";
+            block(level, depth + 1);
+            indent(level);
+            out << "else\n";
+            block(level, depth + 1);
+            break;
+        }
+        }
+    }
+
+    void block(int level, int depth)
+    {
+        indent(level);
+        out << "{\n";
+        scopes.push_back({});
+        int count = 1 + pick(opt.statements);
+        for (int i = 0; i < count; i++)
+            statement(level + 1, depth);
+        scopes.pop_back();
+        indent(level);
+        out << "}\n";
+    }
+
+    void function(int index)
+    {
+        string name = "f" + to_string(index);
+        int params = pick(opt.max_params + 1);
+        comment(0);
+        out << (chance(20) ? "void" : type()) << " " << name << "(";
+        scopes.push_back({});
+        for (int i = 0; i < params; i++)
+        {
+            string param = "p" + to_string(i);
+            out << (i ? ", " : "") << type() << " " << param;
+            scopes.back().push_back(param);
+        }
+        out << ")\n{\n";
+        int count = 1 + pick(opt.statements);
+        for (int i = 0; i < count; i++)
+            statement(1, 0);
+        out << "    return " << expression() << ";\n}\n";
+        scopes.pop_back();
+        functions.push_back({name, params});
+    }
+};
+
+struct Result
+{
+    string name;
+    double seconds;
+    size_t tokens;
+    size_t allocations;
+};
+
+Result benchLexer(string_view source, int repeat)
+{
+    Result best{"getNextToken", 1e30, 0, 0};
+    for (int r = 0; r < repeat; r++)
+    {
+        Interner interner;
+        Lexer lexer(source, &interner);
+        size_t tokens = 0;
+        size_t allocations = allocation_count.load();
+        auto start = chrono::steady_clock::now();
+        for (Token token = lexer.getNextToken(); token.type != TOKEN_EOF; token = lexer.getNextToken())
+            tokens++;
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds < best.seconds)
+            best = {best.name, seconds, tokens, allocation_count.load() - allocations};
+    }
+    return best;
+}
+
+Result benchProcessFile(const string &filename, size_t tokens, int repeat, int jobs)
+{
+    Result best{jobs > 1 ? "processFile --jobs " + to_string(jobs) : "processFile", 1e30, tokens, 0};
+    for (int r = 0; r < repeat; r++)
+    {
+        size_t allocations = allocation_count.load();
+        auto start = chrono::steady_clock::now();
+        processFile(filename, false, jobs);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds < best.seconds)
+        {
+            best.seconds = seconds;
+            best.allocations = allocation_count.load() - allocations;
+        }
+    }
+    return best;
+}
+
+// Discards tokens, so buildSymbolTable runs without writing output files.
+struct NullTokenOutput
+{
+    void emit(const Token &) {}
+};
+
+struct SymbolTableSize
+{
+    size_t symbols;
+    size_t bytes_used;
+    size_t bytes_reserved;
+};
+
+// Builds the symbol table for source and reports its footprint.
+SymbolTableSize measureSymbolTable(string_view source)
+{
+    Interner interner;
+    SymbolTable symtab(interner);
+    Lexer lexer(source, &interner);
+    NullTokenOutput out;
+    buildSymbolTable(lexer, symtab, out);
+    return {symtab.symbolCount(), symtab.bytesUsed(), symtab.bytesReserved()};
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorOptions opt;
+    bool json = false;
+    int repeat = 3;
+    int jobs = 1;
+    string workFile = "lexer_bench_input.txt";
+    bool keep = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        auto value = [&]() -> int
+        {
+            if (i + 1 >= argc)
+            {
+                cerr << "Missing value for " << arg << "\n";
+                exit(1);
+            }
+            return atoi(argv[++i]);
+        };
+        if (arg == "--functions")
+            opt.functions = value();
+        else if (arg == "--globals")
+            opt.globals = max(1, value());
+        else if (arg == "--statements")
+            opt.statements = max(1, value());
+        else if (arg == "--depth")
+            opt.depth = value();
+        else if (arg == "--params")
+            opt.max_params = value();
+        else if (arg == "--comments")
+            opt.comment_percent = value();
+        else if (arg == "--seed")
+            opt.seed = value();
+        else if (arg == "--repeat")
+            repeat = max(1, value());
+        else if (arg == "--jobs")
+            jobs = max(1, value());
+        else if (arg == "--json")
+            json = true;
+        else if (arg == "--keep" && i + 1 < argc)
+        {
+            workFile = argv[++i];
+            keep = true;
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0]
+                 << " [--functions N] [--globals N] [--statements N] [--depth N] [--params N]\n"
+                 << "       [--comments PERCENT] [--seed N] [--repeat N] [--jobs N] [--keep FILE] [--json]\n";
+            return 1;
+        }
+    }
+
+    string program = ProgramGenerator(opt).generate();
+    {
+        ofstream file(workFile, ios::binary);
+        file << program;
+    }
+
+    vector<Result> results;
+    results.push_back(benchLexer(program, repeat));
+    size_t tokens = results[0].tokens;
+    results.push_back(benchProcessFile(workFile, tokens, repeat, 1));
+    if (jobs > 1)
+        results.push_back(benchProcessFile(workFile, tokens, repeat, jobs));
+
+    if (!keep)
+    {
+        // processFile wrote the token stream and symbol table next to it
+        remove(workFile.c_str());
+        remove((workFile + ".parse").c_str());
+        remove((workFile + ".symtab").c_str());
+    }
+
+    SymbolTableSize table = measureSymbolTable(program);
+    double per_symbol = table.symbols ? (double)table.bytes_used / table.symbols : 0.0;
+
+    double mb = program.size() / 1e6;
+    if (json)
+    {
+        printf("{\n  \"benchmark\": \"lexer\",\n");
+        printf("  \"input\": {\"bytes\": %zu, \"tokens\": %zu, \"functions\": %d, \"statements\": %d, \"depth\": %d, \"seed\": %u},\n",
+               program.size(), tokens, opt.functions, opt.statements, opt.depth, opt.seed);
+        printf("  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result &r = results[i];
+            printf("    {\"name\": \"%s\", \"seconds\": %.6f, \"mb_per_s\": %.2f, \"tokens_per_s\": %.0f, \"allocs_per_token\": %.4f}%s\n",
+                   r.name.c_str(), r.seconds, mb / r.seconds, r.tokens / r.seconds,
+                   (double)r.allocations / r.tokens, i + 1 < results.size() ? "," : "");
+        }
+        printf("  ],\n");
+        printf("  \"symbol_table\": {\"symbols\": %zu, \"bytes_used\": %zu, \"bytes_reserved\": %zu, \"bytes_per_symbol\": %.1f}\n}\n",
+               table.symbols, table.bytes_used, table.bytes_reserved, per_symbol);
+    }
+    else
+    {
+        printf("Input: %.2f MB, %zu tokens (%d functions, depth %d, seed %u)\n",
+               mb, tokens, opt.functions, opt.depth, opt.seed);
+        printf("%-22s %10s %10s %14s %14s\n", "benchmark", "seconds", "MB/s", "tokens/s", "allocs/token");
+        for (const Result &r : results)
+        {
+            printf("%-22s %10.4f %10.1f %14.0f %14.4f\n", r.name.c_str(), r.seconds, mb / r.seconds,
+                   r.tokens / r.seconds, (double)r.allocations / r.tokens);
+        }
+        printf("Symbol table: %zu symbols, %zu bytes used (%.1f bytes/symbol), %zu bytes reserved\n",
+               table.symbols, table.bytes_used, per_symbol, table.bytes_reserved);
+    }
+    return 0;
+}
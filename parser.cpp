@@ -1,726 +1,349 @@
-#include <iostream>
-#include <fstream>
-#include <vector>
-#include <unordered_map>
-#include <unordered_set>
-#include <queue>
-#include <sstream>
-#include <algorithm>
-#include <cctype>
-#include <stack>
-#include <functional>
+#include "parser.h"
 
-using namespace std;
-
-struct Production
+// Parses the input repeatedly through one reused Parser, with the dense and
+// with the compressed tables, and reports table size and throughput.
+void bench_parser(const char *name, Parser &parser, size_t bytes, const vector<int> &tokens, int repeat)
 {
-    string lhs;
-    vector<string> rhs;
-    int id;
-
-    bool operator==(const Production &other) const
+    bool accepted = false;
+    double best = 1e30;
+    for (int r = 0; r < repeat; r++)
     {
-        return lhs == other.lhs && rhs == other.rhs;
+        auto start = chrono::steady_clock::now();
+        accepted = parser.parse(tokens);
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
     }
-};
-
-namespace std
-{
-    template <>
-    struct hash<Production>
-    {
-        size_t operator()(const Production &p) const
-        {
-            size_t h1 = hash<string>()(p.lhs);
-            size_t h2 = 0;
-            for (const auto &sym : p.rhs)
-            {
-                h2 ^= hash<string>()(sym) + 0x9e3779b9 + (h2 << 6) + (h2 >> 2);
-            }
-            return h1 ^ (h2 << 1);
-        }
-    };
+    printf("%-12s %10zu %12.6f %14.0f %s\n", name, bytes, best, tokens.size() / best,
+           accepted ? "valid" : "invalid");
 }
 
-class Grammar
+// Writes a self-contained header with the tables as constexpr arrays and a
+// parse loop over them, so a front end can be compiled against this grammar
+// with no table construction at startup.
+bool emit_cpp(const string &filename, const string &grammar_file, const Grammar &grammar, const CanonicalLR1 &clr)
 {
-public:
-    vector<Production> productions;
-    unordered_set<string> terminals;
-    unordered_set<string> non_terminals;
-    string start_symbol;
-    string augmented_start = "<$START>";
-    unordered_map<string, unordered_set<string>> first;
-    unordered_map<string, unordered_set<string>> follow;
+    ofstream out(filename);
+    if (!out.is_open())
+        return false;
+    const ParseTables &tables = clr.tables;
 
-    void load(const string &filename)
+    // Include guard from the file name, reduced to [A-Z0-9_] and never
+    // starting with a digit or an underscore.
+    string guard;
+    for (char c : filename.substr(filename.find_last_of('/') + 1))
     {
-        ifstream file(filename);
-        if (!file.is_open())
-        {
-            cerr << "Error opening grammar file." << endl;
-            return;
-        }
-
-        string line;
-        bool first_production = true;
-        int prod_id = 0;
-
-        while (getline(file, line))
-        {
-            line = trim(line);
-            if (line.empty())
-                continue;
-
-            size_t arrow_pos = line.find("->");
-            if (arrow_pos == string::npos)
-                continue;
-
-            string lhs = trim(line.substr(0, arrow_pos));
-            string rhs_str = trim(line.substr(arrow_pos + 2));
-
-            if (first_production)
-            {
-                start_symbol = lhs;
-                first_production = false;
-            }
-
-            vector<string> alternatives = split_alternatives(rhs_str);
-
-            for (const auto &alt : alternatives)
-            {
-                Production prod;
-                prod.lhs = lhs;
-                prod.rhs = split_symbols(alt);
-                prod.id = prod_id++;
-                productions.push_back(prod);
-            }
-        }
-
-        augment_grammar();
-        compute_first();
-        compute_follow();
+        if (c >= 'a' && c <= 'z')
+            guard += (char)(c - 'a' + 'A');
+        else if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+            guard += c;
+        else
+            guard += '_';
     }
+    if (guard.empty() || !(guard[0] >= 'A' && guard[0] <= 'Z'))
+        guard = "GENERATED_" + guard;
 
-    void augment_grammar()
+    auto write_array = [&](const char *name, const vector<int32_t> &values)
     {
-        Production aug_prod;
-        aug_prod.lhs = augmented_start;
-        aug_prod.rhs = {start_symbol};
-        aug_prod.id = productions.size();
-        productions.insert(productions.begin(), aug_prod);
-        non_terminals.insert(augmented_start);
-        start_symbol = augmented_start;
-    }
+        out << "    inline constexpr int32_t " << name << "[" << max<size_t>(values.size(), 1) << "] = {";
+        for (size_t i = 0; i < values.size(); i++)
+            out << (i % 16 ? " " : "\n        ") << values[i] << ",";
+        out << "\n    };\n\n";
+    };
 
-    void compute_first()
+    out << "// Generated by parser --emit-cpp from " << grammar_file << " (" << tableModeName(clr.mode) << ", "
+        << tables.num_states << " states). Do not edit.\n";
+    out << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+    out << "#include <cstddef>\n#include <cstdint>\n#include <string_view>\n#include <vector>\n\n";
+    out << "namespace generated_parser\n{\n";
+    out << "    inline constexpr int NUM_STATES = " << tables.num_states << ";\n";
+    out << "    inline constexpr int NUM_TERMINALS = " << tables.num_terminals << ";\n";
+    out << "    inline constexpr int NUM_SYMBOLS = " << tables.num_terminals + tables.num_nonterminals << ";\n";
+    out << "    inline constexpr int NUM_PRODUCTIONS = " << tables.production_lhs.size() << ";\n";
+    out << "    inline constexpr int END_MARKER = " << END_MARKER << ";\n\n";
+
+    out << "    // Symbol names by ID; IDs below NUM_TERMINALS are terminals.\n";
+    out << "    inline constexpr std::string_view SYMBOL_NAMES[NUM_SYMBOLS] = {";
+    for (size_t i = 0; i < grammar.symbol_names.size(); i++)
     {
-        for (const auto &prod : productions)
-        {
-            for (const auto &sym : prod.rhs)
-            {
-                if (is_terminal(sym))
-                {
-                    terminals.insert(sym);
-                }
-                else
-                {
-                    non_terminals.insert(sym);
-                }
-            }
-        }
-        terminals.insert("$");
-
-        for (const auto &t : terminals)
-        {
-            first[t].insert(t);
-        }
-
-        for (const auto &nt : non_terminals)
+        string escaped;
+        for (char c : grammar.symbol_names[i])
+            escaped += (c == '"' || c == '\\') ? string("\\") + c : string(1, c);
+        out << (i % 8 ? " " : "\n        ") << '"' << escaped << "\",";
+    }
+    out << "\n    };\n\n";
+
+    out << "    // ACTION[state * NUM_TERMINALS + terminal]: low two bits are the kind\n"
+        << "    // (0 error, 1 shift, 2 reduce, 3 accept), the rest the target state or production.\n";
+    write_array("ACTION", tables.action);
+    out << "    // GOTO[state * (NUM_SYMBOLS - NUM_TERMINALS) + non-terminal - NUM_TERMINALS], -1 if none.\n";
+    write_array("GOTO", tables.goto_state);
+    write_array("PRODUCTION_LHS", tables.production_lhs);
+    write_array("PRODUCTION_LENGTH", tables.production_length);
+
+    out << R"(    // Terminal ID of a token name (as printed by tokenTypeToString), or -1.
+    constexpr int terminalId(std::string_view name)
+    {
+        for (int t = END_MARKER; t < NUM_TERMINALS; t++)
         {
-            first[nt] = unordered_set<string>();
+            if (SYMBOL_NAMES[t] == name)
+                return t;
         }
-
-        bool changed;
-        do
-        {
-            changed = false;
-            for (const auto &prod : productions)
-            {
-                const string &lhs = prod.lhs;
-                const auto &rhs = prod.rhs;
-
-                unordered_set<string> new_first = compute_first_for_sequence(rhs);
-
-                for (const auto &sym : new_first)
-                {
-                    if (first[lhs].find(sym) == first[lhs].end())
-                    {
-                        first[lhs].insert(sym);
-                        changed = true;
-                    }
-                }
-            }
-        } while (changed);
+        return -1;
     }
 
-    unordered_set<string> compute_first_for_sequence(const vector<string> &seq)
+    // Parses count terminal IDs; the end marker is implied. The stack is
+    // reused between calls, so steady-state parsing does not allocate.
+    inline bool parse(const int *tokens, size_t count, std::vector<int> &stack)
     {
-        unordered_set<string> result;
-        bool can_derive_epsilon = true;
-
-        for (const auto &sym : seq)
+        stack.clear();
+        stack.push_back(0);
+        size_t pos = 0;
+        while (true)
         {
-            const auto &sym_first = first[sym];
-            bool has_epsilon = sym_first.find("EPSILON") != sym_first.end();
-
-            for (const auto &s : sym_first)
+            int token = pos < count ? tokens[pos] : END_MARKER;
+            if (token < 0 || token >= NUM_TERMINALS)
+                return false;
+            int32_t action = ACTION[stack.back() * NUM_TERMINALS + token];
+            switch (action & 3)
             {
-                if (s != "EPSILON")
-                {
-                    result.insert(s);
-                }
-            }
-
-            if (!has_epsilon)
+            case 1:
+                stack.push_back(action >> 2);
+                pos++;
+                break;
+            case 2:
             {
-                can_derive_epsilon = false;
+                int prod = action >> 2;
+                stack.resize(stack.size() - PRODUCTION_LENGTH[prod]);
+                int32_t target = GOTO[stack.back() * (NUM_SYMBOLS - NUM_TERMINALS) + PRODUCTION_LHS[prod] - NUM_TERMINALS];
+                if (target < 0)
+                    return false;
+                stack.push_back(target);
                 break;
             }
-        }
-
-        if (can_derive_epsilon)
-        {
-            result.insert("EPSILON");
-        }
-
-        return result;
-    }
-
-    void compute_follow()
-    {
-        follow[start_symbol].insert("$");
-
-        bool changed;
-        do
-        {
-            changed = false;
-            for (const auto &prod : productions)
-            {
-                const auto &rhs = prod.rhs;
-                for (size_t i = 0; i < rhs.size(); ++i)
-                {
-                    const string &B = rhs[i];
-                    if (non_terminals.find(B) == non_terminals.end())
-                        continue;
-
-                    vector<string> beta(rhs.begin() + i + 1, rhs.end());
-                    unordered_set<string> first_beta = compute_first_for_sequence(beta);
-
-                    size_t before_size = follow[B].size();
-                    for (const auto &s : first_beta)
-                    {
-                        if (s != "EPSILON")
-                        {
-                            follow[B].insert(s);
-                        }
-                    }
-                    if (follow[B].size() != before_size)
-                    {
-                        changed = true;
-                    }
-
-                    if (first_beta.find("EPSILON") != first_beta.end() || beta.empty())
-                    {
-                        before_size = follow[B].size();
-                        for (const auto &s : follow[prod.lhs])
-                        {
-                            follow[B].insert(s);
-                        }
-                        if (follow[B].size() != before_size)
-                        {
-                            changed = true;
-                        }
-                    }
-                }
+            case 3:
+                return true;
+            default:
+                return false;
             }
-        } while (changed);
-    }
-
-    bool is_terminal(const string &sym)
-    {
-        return !sym.empty() && sym.front() != '<';
-    }
-
-    static string trim(const string &s)
-    {
-        size_t start = s.find_first_not_of(" \t");
-        size_t end = s.find_last_not_of(" \t");
-        if (start == string::npos)
-            return "";
-        return s.substr(start, end - start + 1);
-    }
-
-    static vector<string> split_alternatives(const string &s)
-    {
-        vector<string> alternatives;
-        stringstream ss(s);
-        string alt;
-        while (getline(ss, alt, '|'))
-        {
-            alternatives.push_back(trim(alt));
         }
-        return alternatives;
     }
+}
 
-    static vector<string> split_symbols(const string &s)
-    {
-        vector<string> symbols;
-        stringstream ss(s);
-        string sym;
-        while (ss >> sym)
-        {
-            if (sym == "EPSILON")
-                continue;
-            symbols.push_back(sym);
-        }
-        return symbols;
-    }
+#endif
+)";
+    return bool(out);
+}
 
-    void write_augmented_grammar(const string &filename)
+// Reads the lexer's binary token stream as terminal IDs, ending with
+// END_MARKER. Older space-separated text .parse files are still accepted.
+// Token names are only materialized when names is given (for the full trace).
+vector<int> read_input(const string &filename, const Grammar &grammar, vector<string> *names = nullptr)
+{
+    vector<int> tokens;
     {
-        ofstream file(filename);
-        file << "Augmented Grammar:\n";
-        file << "Start Symbol: " << start_symbol << "\n\n";
-        for (const auto &prod : productions)
+        SourceBuffer file(filename);
+        if (!TokenStreamReader::isTokenStream(file.view()))
         {
-            file << prod.lhs << " -> ";
-            for (const auto &sym : prod.rhs)
+            stringstream ss{string(file.view())};
+            string token;
+            while (ss >> token)
             {
-                file << sym << " ";
+                tokens.push_back(grammar.terminal_id(token));
+                if (names)
+                    names->push_back(token);
             }
-            file << "\n";
+            tokens.push_back(END_MARKER);
+            if (names)
+                names->push_back("$");
+            return tokens;
         }
     }
 
-    void write_symbols(const string &filename)
-    {
-        ofstream file(filename);
-        file << "Terminals:\n";
-        for (const auto &t : terminals)
-            file << t << "\n";
-        file << "\nNon-Terminals:\n";
-        for (const auto &nt : non_terminals)
-            file << nt << "\n";
-    }
-};
-
-struct LR1Item
-{
-    const Production *prod;
-    int dot_pos;
-    string lookahead;
+    // Token kind -> terminal ID, looked up by name once per kind
+    int kind_ids[TOKEN_ERROR + 1];
+    for (int kind = 0; kind <= TOKEN_ERROR; kind++)
+        kind_ids[kind] = grammar.terminal_id(tokenTypeToString(static_cast<TokenType>(kind)));
 
-    bool operator==(const LR1Item &other) const
+    TokenStreamReader stream(filename);
+    tokens.reserve(stream.size() + 1);
+    for (const TokenRecord &record : stream)
     {
-        return prod == other.prod && dot_pos == other.dot_pos && lookahead == other.lookahead;
+        tokens.push_back(record.kind <= TOKEN_ERROR ? kind_ids[record.kind] : -1);
+        if (names)
+            names->push_back(tokenTypeToString(static_cast<TokenType>(record.kind)));
     }
-};
+    tokens.push_back(END_MARKER);
+    if (names)
+        names->push_back("$");
+    return tokens;
+}
 
-namespace std
+int main(int argc, char *argv[])
 {
-    template <>
-    struct hash<LR1Item>
+    vector<string> files;
+    TableMode mode = TABLE_CLR;
+    bool show_stats = false;
+    bool compress = false;
+    bool use_cache = true;
+    string emit_file;
+    int threads = 1;
+    TraceLevel trace = TRACE_OFF;
+    string decode_file;
+    int bench_repeat = 0;
+    bool usage_error = false;
+    for (int i = 1; i < argc; i++)
     {
-        size_t operator()(const LR1Item &item) const
+        string arg = argv[i];
+        if (arg == "--table" && i + 1 < argc)
         {
-            size_t h1 = hash<const Production *>()(item.prod);
-            size_t h2 = hash<int>()(item.dot_pos);
-            size_t h3 = hash<string>()(item.lookahead);
-            return h1 ^ (h2 << 1) ^ (h3 << 2);
+            string value = argv[++i];
+            if (value == "clr")
+                mode = TABLE_CLR;
+            else if (value == "lalr")
+                mode = TABLE_LALR;
+            else if (value == "ielr")
+                mode = TABLE_IELR;
+            else
+                usage_error = true;
         }
-    };
-}
-
-class CanonicalLR1
-{
-public:
-    Grammar *grammar;
-    vector<unordered_set<LR1Item>> states;
-    unordered_map<int, unordered_map<string, int>> goto_table;
-    unordered_map<int, unordered_map<string, string>> action_table;
-
-    void build(Grammar &g)
-    {
-        grammar = &g;
-        const Production &aug_prod = g.productions[0];
-        LR1Item initial_item{&aug_prod, 0, "$"};
-        auto initial_closure = closure({initial_item});
-        states.push_back(initial_closure);
-
-        queue<int> process_queue;
-        process_queue.push(0);
-
-        unordered_map<int, bool> processed;
-
-        while (!process_queue.empty())
+        else if (arg == "--stats")
+            show_stats = true;
+        else if (arg == "--compress")
+            compress = true;
+        else if (arg == "--no-cache")
+            use_cache = false;
+        else if (arg == "--threads" && i + 1 < argc)
         {
-            int state_idx = process_queue.front();
-            process_queue.pop();
-
-            if (processed[state_idx])
-                continue;
-            processed[state_idx] = true;
-
-            unordered_set<string> symbols;
-            for (const auto &item : states[state_idx])
-            {
-                if (item.dot_pos < item.prod->rhs.size())
-                {
-                    symbols.insert(item.prod->rhs[item.dot_pos]);
-                }
-            }
-
-            for (const auto &sym : symbols)
-            {
-                auto new_state = goto_state(states[state_idx], sym);
-                if (new_state.empty())
-                    continue;
-
-                int new_state_idx = -1;
-                for (size_t i = 0; i < states.size(); ++i)
-                {
-                    if (states[i] == new_state)
-                    {
-                        new_state_idx = i;
-                        break;
-                    }
-                }
-
-                if (new_state_idx == -1)
-                {
-                    states.push_back(new_state);
-                    new_state_idx = states.size() - 1;
-                    process_queue.push(new_state_idx);
-                }
-
-                if (grammar->terminals.count(sym))
-                {
-                    action_table[state_idx][sym] = "s" + to_string(new_state_idx);
-                }
-                else
-                {
-                    goto_table[state_idx][sym] = new_state_idx;
-                }
-            }
+            threads = atoi(argv[++i]);
+            if (threads < 1)
+                usage_error = true;
         }
-
-        for (size_t state_idx = 0; state_idx < states.size(); ++state_idx)
+        else if (arg == "--trace" && i + 1 < argc)
         {
-            for (const auto &item : states[state_idx])
-            {
-                if (item.dot_pos == item.prod->rhs.size())
-                {
-                    string la = item.lookahead;
-                    if (item.prod->lhs == grammar->augmented_start && la == "$")
-                    {
-                        action_table[state_idx][la] = "acc";
-                    }
-                    else
-                    {
-                        int prod_idx = find_production_index(*item.prod);
-                        if (prod_idx == -1)
-                            continue;
-                        if (action_table[state_idx].count(la) && action_table[state_idx][la] != "r" + to_string(prod_idx))
-                        {
-                            cerr << "Conflict in action table!" << endl;
-                        }
-                        action_table[state_idx][la] = "r" + to_string(prod_idx);
-                    }
-                }
-            }
+            string value = argv[++i];
+            if (value == "off")
+                trace = TRACE_OFF;
+            else if (value == "actions")
+                trace = TRACE_ACTIONS;
+            else if (value == "full")
+                trace = TRACE_FULL;
+            else
+                usage_error = true;
         }
-    }
-
-    unordered_set<LR1Item> closure(const unordered_set<LR1Item> &items)
-    {
-        unordered_set<LR1Item> closure_set = items;
-        queue<LR1Item> q;
-        for (const auto &item : items)
-            q.push(item);
-
-        while (!q.empty())
+        else if (arg == "--decode-trace" && i + 1 < argc)
+            decode_file = argv[++i];
+        else if (arg == "--emit-cpp" && i + 1 < argc)
+            emit_file = argv[++i];
+        else if (arg == "--bench" && i + 1 < argc)
         {
-            LR1Item item = q.front();
-            q.pop();
-
-            if (item.dot_pos >= item.prod->rhs.size())
-                continue;
-            string B = item.prod->rhs[item.dot_pos];
-            if (grammar->non_terminals.find(B) == grammar->non_terminals.end())
-                continue;
-
-            vector<string> beta(item.prod->rhs.begin() + item.dot_pos + 1, item.prod->rhs.end());
-            beta.push_back(item.lookahead);
-            auto first_beta = grammar->compute_first_for_sequence(beta);
-
-            for (const auto &prod : grammar->productions)
-            {
-                if (prod.lhs == B)
-                {
-                    for (const auto &b : first_beta)
-                    {
-                        if (b == "EPSILON")
-                            continue;
-                        LR1Item new_item{&prod, 0, b};
-                        if (closure_set.insert(new_item).second)
-                        {
-                            q.push(new_item);
-                        }
-                    }
-                }
-            }
+            bench_repeat = atoi(argv[++i]);
+            if (bench_repeat < 1)
+                usage_error = true;
         }
-
-        return closure_set;
+        else
+            files.push_back(arg);
     }
-
-    unordered_set<LR1Item> goto_state(const unordered_set<LR1Item> &state, const string &sym)
+    if (!decode_file.empty() && files.empty() && !usage_error)
     {
-        unordered_set<LR1Item> moved;
-
-        for (const auto &item : state)
+        try
         {
-            if (item.dot_pos < item.prod->rhs.size() && item.prod->rhs[item.dot_pos] == sym)
-            {
-                LR1Item new_item = item;
-                new_item.dot_pos++;
-                moved.insert(new_item);
-            }
+            decode_trace(decode_file, cout);
         }
-
-        return closure(moved);
-    }
-
-    int find_production_index(const Production &p)
-    {
-        for (size_t i = 0; i < grammar->productions.size(); ++i)
+        catch (const exception &e)
         {
-            if (grammar->productions[i] == p)
-            {
-                return i;
-            }
+            cerr << "Error: " << e.what() << endl;
+            return 1;
         }
-        return -1;
+        return 0;
     }
-
-    void write_item_sets(const string &filename)
+    if (files.size() != (emit_file.empty() ? 2u : 1u) || usage_error || !decode_file.empty())
     {
-        ofstream file(filename);
-        for (size_t i = 0; i < states.size(); i++)
-        {
-            file << "State " << i << ":\n";
-            unordered_map<string, int> transitions;
-
-            // Collect transitions
-            if (goto_table.count(i))
-            {
-                for (const auto &entry : goto_table[i])
-                {
-                    transitions[entry.first] = entry.second;
-                }
-            }
-            if (action_table.count(i))
-            {
-                for (const auto &entry : action_table[i])
-                {
-                    if (entry.second[0] == 's')
-                    {
-                        transitions[entry.first] = stoi(entry.second.substr(1));
-                    }
-                }
-            }
-
-            // Print items
-            for (const auto &item : states[i])
-            {
-                file << "  ";
-                file << item.prod->lhs << " -> ";
-                for (size_t j = 0; j < item.prod->rhs.size(); j++)
-                {
-                    if (j == item.dot_pos)
-                        file << ". ";
-                    file << item.prod->rhs[j] << " ";
-                }
-                if (item.dot_pos == item.prod->rhs.size())
-                    file << ". ";
-                file << "[" << item.lookahead << "]\n";
-            }
-
-            // Print transitions
-            file << "\n  Transitions:\n";
-            for (const auto &[sym, state] : transitions)
-            {
-                file << "    " << sym << " -> " << state << "\n";
-            }
-            file << "------------------------\n";
-        }
+        cerr << "Usage: " << argv[0] << " [--table lalr|ielr|clr] [--trace off|actions|full] [--stats] [--compress]\n"
+             << "       " << string(strlen(argv[0]), ' ') << " [--no-cache] [--threads N] [--bench N] <input_file> <grammar_file>\n"
+             << "       " << argv[0] << " [--table lalr|ielr|clr] [--no-cache] [--threads N] --emit-cpp <out.hpp> <grammar_file>\n"
+             << "       " << argv[0] << " --decode-trace parsing_trace.bin > parsing_steps.txt" << endl;
+        return 1;
     }
+    const string &grammar_file = files.back();
 
-    void write_parsing_table(const string &filename)
+    Grammar grammar;
+    CanonicalLR1 clr;
+    bool cached;
+    try
     {
-        ofstream file(filename);
-        file << "Parsing Table:\n";
-        file << "State\tAction\n";
-        for (const auto &[state, actions] : action_table)
-        {
-            file << state << "\t";
-            for (const auto &[term, action] : actions)
-            {
-                file << term << ":" << action << " ";
-            }
-            file << "\n";
-        }
-
-        file << "\nGoto Table:\n";
-        for (const auto &[state, gotos] : goto_table)
-        {
-            file << state << "\t";
-            for (const auto &[nonterm, dest] : gotos)
-            {
-                file << nonterm << ":" << dest << " ";
-            }
-            file << "\n";
-        }
+        cached = load_tables(grammar_file, mode, use_cache, threads, grammar, clr);
     }
-};
-
-class Parser
-{
-    ofstream step_file;
-
-public:
-    CanonicalLR1 &clr;
-    stack<pair<int, string>> state_stack;
-
-    Parser(CanonicalLR1 &clr, const string &filename) : clr(clr)
+    catch (const exception &e)
     {
-        state_stack.push({0, ""});
-        step_file.open(filename);
-        step_file << "Parsing Steps:\n";
+        cerr << "Error: " << e.what() << endl;
+        return 1;
     }
-
-    ~Parser() { step_file.close(); }
-
-    void log_state(size_t pos, const vector<string> &tokens)
+    cerr << tableModeName(mode) << " table: " << clr.tables.num_states << " states ("
+         << clr.canonical_state_count << " canonical" << (cached ? ", cached" : "") << ")" << endl;
+    if (!emit_file.empty())
     {
-        step_file << "Stack: ";
-        stack<pair<int, string>> temp = state_stack;
-        while (!temp.empty())
+        if (!emit_cpp(emit_file, grammar_file, grammar, clr))
         {
-            step_file << temp.top().first << " ";
-            temp.pop();
+            cerr << "Error: cannot write " << emit_file << endl;
+            return 1;
         }
-        step_file << "\nInput: ";
-        for (size_t i = pos; i < tokens.size(); i++)
-        {
-            step_file << tokens[i] << " ";
-        }
-        step_file << "\n";
+        return 0;
     }
-
-    bool parse(const vector<string> &input)
+    if (show_stats && cached)
+        cerr << "closure: stats unavailable for cached tables (use --no-cache)" << endl;
+    else if (show_stats)
     {
-        vector<string> tokens = input;
-        tokens.push_back("$");
-        size_t pos = 0;
-
-        while (pos < tokens.size())
-        {
-            log_state(pos, tokens);
-            int current_state = state_stack.top().first;
-            string current_token = tokens[pos];
-
-            if (clr.action_table[current_state].find(current_token) == clr.action_table[current_state].end())
-            {
-                return false;
-            }
-
-            string action = clr.action_table[current_state][current_token];
-
-            if (action == "acc")
-            {
-                return true;
-            }
-            else if (action[0] == 's')
-            {
-                int new_state = stoi(action.substr(1));
-                state_stack.push({new_state, current_token});
-                pos++;
-            }
-            else if (action[0] == 'r')
-            {
-                int prod_idx = stoi(action.substr(1));
-                const Production &prod = clr.grammar->productions[prod_idx];
-                for (size_t i = 0; i < prod.rhs.size(); ++i)
-                {
-                    state_stack.pop();
-                }
-                int new_state = state_stack.top().first;
-                string lhs = prod.lhs;
-                if (clr.goto_table[new_state].find(lhs) == clr.goto_table[new_state].end())
-                {
-                    return false;
-                }
-                int goto_state = clr.goto_table[new_state][lhs];
-                state_stack.push({goto_state, lhs});
-            }
-            else
-            {
-                return false;
-            }
-            step_file << "Action: " << action << "\n\n";
-        }
-
-        return false;
+        const auto &st = clr.stats;
+        cerr << "closure: " << st.closure_calls << " calls, " << st.expansion_lookups << " expansions, "
+             << st.expansion_hits << " cache hits (" << fixed << setprecision(1)
+             << (st.expansion_lookups ? 100.0 * st.expansion_hits / st.expansion_lookups : 0.0) << "%)" << endl;
     }
-};
 
-vector<string> read_input(const string &filename)
-{
-    ifstream file(filename);
-    vector<string> tokens;
-    string token;
-    while (file >> token)
+    if (compress || bench_repeat)
     {
-        tokens.push_back(token);
+        clr.compressed.build(clr.tables);
+        cerr << "Table size: " << clr.tables.bytes() << " bytes dense, " << clr.compressed.bytes()
+             << " bytes compressed" << endl;
     }
-    return tokens;
-}
 
-int main(int argc, char *argv[])
-{
-    if (argc < 3)
+    vector<int> tokens;
+    vector<string> names; // Only for the full trace
+    try
     {
-        cerr << "Usage: " << argv[0] << " <input_file>" << " <grammar_file>" << endl;
+        tokens = read_input(files.front(), grammar, trace == TRACE_FULL ? &names : nullptr);
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
         return 1;
     }
 
-    Grammar grammar;
-    grammar.load(argv[2]);
-
-    CanonicalLR1 clr;
-    clr.build(grammar);
+    if (bench_repeat)
+    {
+        printf("%-12s %10s %12s %14s %s\n", "layout", "bytes", "seconds", "tokens/s", "result");
+        Parser parser(clr);
+        bench_parser("dense", parser, clr.tables.bytes(), tokens, bench_repeat);
+        parser.use_compressed = true;
+        bench_parser("compressed", parser, clr.compressed.bytes(), tokens, bench_repeat);
+        return 0;
+    }
 
-    vector<string> input = read_input(argv[1]);
-    Parser parser(clr, "parsing_steps.txt");
+    Parser parser(clr, trace);
+    parser.use_compressed = compress;
 
     grammar.write_augmented_grammar("augmented_grammar.txt");
     grammar.write_symbols("terminals_non_terminals.txt");
-    clr.write_item_sets("item_sets.txt");
+    if (!cached)
+        clr.write_item_sets("item_sets.txt");
+    else
+    {
+        // The LR(1) states are not cached; don't leave a stale file from another grammar
+        remove("item_sets.txt");
+        cerr << "item_sets.txt: item sets unavailable for cached tables (use --no-cache)" << endl;
+    }
     clr.write_parsing_table("parsing_table.txt");
 
-    bool result = parser.parse(input);
+    parser.open_trace(names);
+    bool result = parser.parse(tokens);
 
     if (result)
     {
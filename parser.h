@@ -0,0 +1,1951 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+// LR(1) parser generator and driver: grammar loading, FIRST/FOLLOW, the
+// canonical/LALR/IELR collections, parse tables and their cache, tracing and
+// the Parser itself. parser.cpp is the command-line front end.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <queue>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <map>
+#include <iomanip>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "token_stream.h"
+
+using namespace std;
+
+// Grammar symbols are dense integer IDs: EPSILON and the end marker "$" are
+// reserved, the grammar's terminals follow, then the non-terminals. Names are
+// only kept for diagnostics and the output files.
+const int EPSILON = 0;
+const int END_MARKER = 1;
+
+// Fixed-width bitset over terminal IDs. EPSILON is bit 0, so a FIRST set
+// records nullability in the same words as its terminals.
+class TerminalSet
+{
+    vector<uint64_t> words;
+
+public:
+    explicit TerminalSet(int num_terminals = 0) : words((num_terminals + 63) / 64) {}
+
+    void insert(int t) { words[t >> 6] |= 1ULL << (t & 63); }
+    bool contains(int t) const { return (words[t >> 6] >> (t & 63)) & 1; }
+
+    // Adds every member of other, leaving EPSILON out unless with_epsilon is
+    // set. Returns whether anything was added.
+    bool merge(const TerminalSet &other, bool with_epsilon = true)
+    {
+        uint64_t added = 0;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            uint64_t incoming = other.words[i];
+            if (i == 0 && !with_epsilon)
+                incoming &= ~1ULL;
+            added |= incoming & ~words[i];
+            words[i] |= incoming;
+        }
+        return added != 0;
+    }
+
+    void intersect(const TerminalSet &other)
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= other.words[i];
+    }
+
+    bool subset_of(const TerminalSet &other) const
+    {
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            if (words[i] & ~other.words[i])
+                return false;
+        }
+        return true;
+    }
+
+    void clear() { fill(words.begin(), words.end(), 0); }
+
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            for (uint64_t w = words[i]; w; w &= w - 1)
+                f((int)(i * 64 + __builtin_ctzll(w)));
+        }
+    }
+
+    size_t count() const
+    {
+        size_t n = 0;
+        for (uint64_t w : words)
+            n += __builtin_popcountll(w);
+        return n;
+    }
+
+    uint64_t hash() const
+    {
+        uint64_t h = 0;
+        for (uint64_t w : words)
+            h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        return h;
+    }
+
+    bool operator==(const TerminalSet &other) const { return words == other.words; }
+};
+
+struct Production
+{
+    int lhs;
+    vector<int> rhs;
+    int id;
+};
+
+class Grammar
+{
+public:
+    vector<Production> productions;
+    vector<vector<int>> productions_of; // Non-terminal -> indices of its productions
+    vector<string> symbol_names; // ID -> name
+    unordered_map<string, int> symbol_ids;
+    int num_terminals = 0; // IDs below this are EPSILON, "$" and terminals
+    int start_symbol = -1;
+    int augmented_start = -1;
+    vector<TerminalSet> first;  // Per symbol; contains EPSILON if nullable
+    vector<TerminalSet> follow; // Per symbol; only non-terminals are filled
+    vector<size_t> suffix_start; // Production -> index of its suffix_first row
+    vector<TerminalSet> suffix_first; // FIRST(rhs[pos..]) for every production and pos
+
+    void load(const string &filename)
+    {
+        ifstream file(filename);
+        if (!file.is_open())
+            throw runtime_error("Cannot open grammar file " + filename);
+
+        // Read every alternative by name first; IDs can only be handed out
+        // once all terminals are known.
+        vector<pair<string, vector<string>>> named_productions;
+        string line;
+        while (getline(file, line))
+        {
+            line = trim(line);
+            if (line.empty())
+                continue;
+
+            size_t arrow_pos = line.find("->");
+            if (arrow_pos == string::npos)
+                continue;
+
+            string lhs = trim(line.substr(0, arrow_pos));
+            string rhs_str = trim(line.substr(arrow_pos + 2));
+
+            vector<string> alternatives = split_alternatives(rhs_str);
+
+            for (const auto &alt : alternatives)
+            {
+                named_productions.push_back({lhs, split_symbols(alt)});
+            }
+        }
+        if (named_productions.empty())
+            throw runtime_error("No productions in grammar file " + filename);
+
+        assign_symbol_ids(named_productions);
+
+        int prod_id = 0;
+        for (const auto &[lhs, rhs] : named_productions)
+        {
+            Production prod;
+            prod.lhs = symbol_ids[lhs];
+            for (const auto &sym : rhs)
+                prod.rhs.push_back(symbol_ids[sym]);
+            prod.id = prod_id++;
+            productions.push_back(prod);
+        }
+        start_symbol = productions[0].lhs;
+
+        augment_grammar();
+        productions_of.assign(symbol_names.size(), vector<int>());
+        for (size_t p = 0; p < productions.size(); p++)
+            productions_of[productions[p].lhs].push_back(p);
+        compute_first();
+        compute_follow();
+    }
+
+    void assign_symbol_ids(const vector<pair<string, vector<string>>> &named_productions)
+    {
+        auto add = [&](const string &name)
+        {
+            if (symbol_ids.emplace(name, symbol_names.size()).second)
+                symbol_names.push_back(name);
+        };
+        add("EPSILON");
+        add("$");
+        for (const auto &[lhs, rhs] : named_productions)
+            for (const auto &sym : rhs)
+                if (is_terminal_name(sym))
+                    add(sym);
+        num_terminals = symbol_names.size();
+
+        add("<$START>");
+        for (const auto &[lhs, rhs] : named_productions)
+        {
+            add(lhs);
+            for (const auto &sym : rhs)
+                add(sym);
+        }
+    }
+
+    void augment_grammar()
+    {
+        augmented_start = symbol_ids["<$START>"];
+        Production aug_prod;
+        aug_prod.lhs = augmented_start;
+        aug_prod.rhs = {start_symbol};
+        aug_prod.id = productions.size();
+        productions.insert(productions.begin(), aug_prod);
+        start_symbol = augmented_start;
+    }
+
+    // FIRST sets are propagated along "FIRST(A) includes FIRST(X)" edges, one
+    // per symbol X that can start a production of A. Only non-terminals whose
+    // set grew are revisited.
+    void compute_first()
+    {
+        int num_symbols = symbol_names.size();
+        first.assign(num_symbols, TerminalSet(num_terminals));
+        for (int t = END_MARKER; t < num_terminals; t++)
+        {
+            first[t].insert(t);
+        }
+
+        vector<char> nullable = compute_nullable();
+        vector<vector<int>> dependents(num_symbols);
+        for (const auto &prod : productions)
+        {
+            for (int sym : prod.rhs)
+            {
+                if (is_terminal(sym))
+                    first[prod.lhs].insert(sym);
+                else
+                    dependents[sym].push_back(prod.lhs);
+                if (!nullable[sym])
+                    break;
+            }
+        }
+
+        vector<int> worklist;
+        vector<char> queued(num_symbols, 0);
+        for (int nt = num_terminals; nt < num_symbols; nt++)
+        {
+            if (nullable[nt])
+                first[nt].insert(EPSILON);
+            worklist.push_back(nt);
+            queued[nt] = 1;
+        }
+        while (!worklist.empty())
+        {
+            int X = worklist.back();
+            worklist.pop_back();
+            queued[X] = 0;
+            for (int A : dependents[X])
+            {
+                if (first[A].merge(first[X], false) && !queued[A])
+                {
+                    worklist.push_back(A);
+                    queued[A] = 1;
+                }
+            }
+        }
+
+        compute_suffix_first();
+    }
+
+    vector<char> compute_nullable() const
+    {
+        // A production becomes nullable once all of its right-hand side is;
+        // pending counts the symbols still unknown.
+        vector<char> nullable(symbol_names.size(), 0);
+        vector<int> pending(productions.size());
+        vector<vector<int>> uses(symbol_names.size());
+        vector<int> worklist;
+        for (size_t p = 0; p < productions.size(); p++)
+        {
+            const auto &rhs = productions[p].rhs;
+            pending[p] = rhs.size();
+            for (int sym : rhs)
+                uses[sym].push_back(p);
+            if (rhs.empty() && !nullable[productions[p].lhs])
+            {
+                nullable[productions[p].lhs] = 1;
+                worklist.push_back(productions[p].lhs);
+            }
+        }
+        while (!worklist.empty())
+        {
+            int sym = worklist.back();
+            worklist.pop_back();
+            for (int p : uses[sym])
+            {
+                int lhs = productions[p].lhs;
+                if (--pending[p] == 0 && !nullable[lhs])
+                {
+                    nullable[lhs] = 1;
+                    worklist.push_back(lhs);
+                }
+            }
+        }
+        return nullable;
+    }
+
+    // Caches FIRST of every production suffix so closure never has to build a
+    // sequence or a set.
+    void compute_suffix_first()
+    {
+        suffix_start.assign(productions.size(), 0);
+        suffix_first.clear();
+        for (size_t p = 0; p < productions.size(); p++)
+        {
+            const auto &rhs = productions[p].rhs;
+            suffix_start[p] = suffix_first.size();
+            suffix_first.resize(suffix_first.size() + rhs.size() + 1, TerminalSet(num_terminals));
+            TerminalSet *row = &suffix_first[suffix_start[p]];
+            row[rhs.size()].insert(EPSILON);
+            for (size_t i = rhs.size(); i-- > 0;)
+            {
+                row[i].merge(first[rhs[i]], false);
+                if (first[rhs[i]].contains(EPSILON))
+                    row[i].merge(row[i + 1]);
+            }
+        }
+    }
+
+    // Dense ID of the LR(0) item "production p with the dot before rhs[pos]".
+    int item_core(int p, int pos) const { return suffix_start[p] + pos; }
+    int num_item_cores() const { return suffix_first.size(); }
+
+    // FIRST(rhs[pos..]) of production p, with EPSILON if the suffix is nullable.
+    const TerminalSet &first_of_suffix(int p, int pos) const
+    {
+        return suffix_first[suffix_start[p] + pos];
+    }
+
+    // FOLLOW(B) takes FIRST of whatever follows B in each production, and all
+    // of FOLLOW(A) when that remainder is nullable. The second kind of edge is
+    // propagated with a worklist.
+    void compute_follow()
+    {
+        int num_symbols = symbol_names.size();
+        follow.assign(num_symbols, TerminalSet(num_terminals));
+        follow[start_symbol].insert(END_MARKER);
+
+        vector<vector<int>> dependents(num_symbols);
+        for (size_t p = 0; p < productions.size(); p++)
+        {
+            const auto &prod = productions[p];
+            for (size_t i = 0; i < prod.rhs.size(); ++i)
+            {
+                int B = prod.rhs[i];
+                if (is_terminal(B))
+                    continue;
+                const TerminalSet &first_beta = first_of_suffix(p, i + 1);
+                follow[B].merge(first_beta, false);
+                if (first_beta.contains(EPSILON) && B != prod.lhs)
+                    dependents[prod.lhs].push_back(B);
+            }
+        }
+
+        vector<int> worklist;
+        vector<char> queued(num_symbols, 0);
+        for (int nt = num_terminals; nt < num_symbols; nt++)
+        {
+            worklist.push_back(nt);
+            queued[nt] = 1;
+        }
+        while (!worklist.empty())
+        {
+            int A = worklist.back();
+            worklist.pop_back();
+            queued[A] = 0;
+            for (int B : dependents[A])
+            {
+                if (follow[B].merge(follow[A]) && !queued[B])
+                {
+                    worklist.push_back(B);
+                    queued[B] = 1;
+                }
+            }
+        }
+    }
+
+    bool is_terminal(int sym) const
+    {
+        return sym < num_terminals;
+    }
+
+    // Terminal ID for a token name from the lexer, or -1 if the grammar has
+    // no such terminal.
+    int terminal_id(const string &name) const
+    {
+        auto it = symbol_ids.find(name);
+        return it != symbol_ids.end() && it->second != EPSILON && is_terminal(it->second) ? it->second : -1;
+    }
+
+    const string &name(int sym) const { return symbol_names[sym]; }
+
+    static bool is_terminal_name(const string &sym)
+    {
+        return !sym.empty() && sym.front() != '<';
+    }
+
+    static string trim(const string &s)
+    {
+        size_t start = s.find_first_not_of(" \t");
+        size_t end = s.find_last_not_of(" \t");
+        if (start == string::npos)
+            return "";
+        return s.substr(start, end - start + 1);
+    }
+
+    static vector<string> split_alternatives(const string &s)
+    {
+        vector<string> alternatives;
+        stringstream ss(s);
+        string alt;
+        while (getline(ss, alt, '|'))
+        {
+            alternatives.push_back(trim(alt));
+        }
+        return alternatives;
+    }
+
+    static vector<string> split_symbols(const string &s)
+    {
+        vector<string> symbols;
+        stringstream ss(s);
+        string sym;
+        while (ss >> sym)
+        {
+            if (sym == "EPSILON")
+                continue;
+            symbols.push_back(sym);
+        }
+        return symbols;
+    }
+
+    void write_augmented_grammar(const string &filename)
+    {
+        ofstream file(filename);
+        file << "Augmented Grammar:\n";
+        file << "Start Symbol: " << name(start_symbol) << "\n\n";
+        for (const auto &prod : productions)
+        {
+            file << name(prod.lhs) << " -> ";
+            for (int sym : prod.rhs)
+            {
+                file << name(sym) << " ";
+            }
+            file << "\n";
+        }
+    }
+
+    void write_symbols(const string &filename)
+    {
+        ofstream file(filename);
+        file << "Terminals:\n";
+        for (int t = END_MARKER; t < num_terminals; t++)
+            file << name(t) << "\n";
+        file << "\nNon-Terminals:\n";
+        for (int nt = num_terminals; nt < (int)symbol_names.size(); nt++)
+            file << name(nt) << "\n";
+    }
+};
+
+// An LR(1) item core with every lookahead it carries in this state.
+struct LR1Item
+{
+    int prod; // Index into Grammar::productions
+    int dot_pos;
+    TerminalSet lookaheads;
+
+    bool same_core(const LR1Item &other) const
+    {
+        return prod == other.prod && dot_pos == other.dot_pos;
+    }
+
+    bool operator==(const LR1Item &other) const
+    {
+        return same_core(other) && lookaheads == other.lookaheads;
+    }
+};
+
+// A state is stored as its kernel only: the items sorted by core, plus a
+// 64-bit hash of them. An LR(1) state is determined by its kernel, so two
+// states are the same exactly when their kernels are. The closure is derived
+// when it is needed.
+struct Kernel
+{
+    vector<LR1Item> items;
+    uint64_t hash = 0;
+
+    explicit Kernel(vector<LR1Item> kernel_items) : items(move(kernel_items))
+    {
+        sort(items.begin(), items.end(), [](const LR1Item &a, const LR1Item &b)
+             { return a.prod != b.prod ? a.prod < b.prod : a.dot_pos < b.dot_pos; });
+        hash = 0xcbf29ce484222325ULL;
+        for (const auto &item : items)
+        {
+            uint64_t packed = ((uint64_t)item.prod << 32) ^ (uint64_t)item.dot_pos ^ item.lookaheads.hash();
+            hash = (hash ^ packed) * 0x100000001b3ULL;
+            hash ^= hash >> 29;
+        }
+    }
+
+    bool operator==(const Kernel &other) const
+    {
+        return hash == other.hash && items == other.items;
+    }
+};
+
+// Parse actions are packed into one int32: the low two bits are the kind and
+// the rest is the shift target or the production to reduce by.
+enum ActionKind
+{
+    ACTION_ERROR = 0,
+    ACTION_SHIFT = 1,
+    ACTION_REDUCE = 2,
+    ACTION_ACCEPT = 3
+};
+
+inline int32_t encodeAction(ActionKind kind, int value = 0) { return (value << 2) | kind; }
+inline ActionKind actionKind(int32_t action) { return static_cast<ActionKind>(action & 3); }
+inline int actionValue(int32_t action) { return action >> 2; }
+
+inline string actionToString(int32_t action)
+{
+    switch (actionKind(action))
+    {
+    case ACTION_SHIFT:
+        return "s" + to_string(actionValue(action));
+    case ACTION_REDUCE:
+        return "r" + to_string(actionValue(action));
+    case ACTION_ACCEPT:
+        return "acc";
+    default:
+        return "";
+    }
+}
+
+// Dense ACTION/GOTO tables. ACTION has one cell per (state, terminal ID),
+// GOTO one per (state, non-terminal ID - num_terminals) holding the target
+// state or -1. The production arrays are what a reduce needs.
+struct ParseTables
+{
+    int num_states = 0;
+    int num_terminals = 0;
+    int num_nonterminals = 0;
+    vector<int32_t> action;
+    vector<int32_t> goto_state;
+    vector<int32_t> production_lhs;
+    vector<int32_t> production_length;
+
+    void reset(int states, const Grammar &grammar)
+    {
+        num_states = states;
+        num_terminals = grammar.num_terminals;
+        num_nonterminals = grammar.symbol_names.size() - grammar.num_terminals;
+        action.assign((size_t)num_states * num_terminals, encodeAction(ACTION_ERROR));
+        goto_state.assign((size_t)num_states * num_nonterminals, -1);
+        production_lhs.clear();
+        production_length.clear();
+        for (const auto &prod : grammar.productions)
+        {
+            production_lhs.push_back(prod.lhs);
+            production_length.push_back(prod.rhs.size());
+        }
+    }
+
+    int32_t &action_at(int state, int terminal) { return action[(size_t)state * num_terminals + terminal]; }
+    int32_t action_at(int state, int terminal) const { return action[(size_t)state * num_terminals + terminal]; }
+    int32_t &goto_at(int state, int nonterminal) { return goto_state[(size_t)state * num_nonterminals + nonterminal - num_terminals]; }
+    int32_t goto_at(int state, int nonterminal) const { return goto_state[(size_t)state * num_nonterminals + nonterminal - num_terminals]; }
+
+    size_t bytes() const
+    {
+        return (action.size() + goto_state.size() + production_lhs.size() + production_length.size()) * sizeof(int32_t);
+    }
+};
+
+// ParseTables packed the way yacc does it. A state whose only action is a
+// single reduce keeps just that as its default action. The other ACTION rows,
+// and the GOTO columns, are overlaid into one comb vector each by row
+// displacement: a row's entry for column c sits at base + c, and the check
+// array records which row owns each slot. A lookup that misses the check
+// falls back to the default (error for ACTION, the most common target for
+// GOTO, which is never consulted for a missing entry).
+struct CompressedTables
+{
+    int num_states = 0;
+    int num_terminals = 0;
+    vector<int32_t> default_action; // Per state
+    vector<int32_t> action_base;    // Per state
+    vector<int32_t> action_entries;
+    vector<int32_t> action_check;
+    vector<int32_t> default_goto; // Per non-terminal
+    vector<int32_t> goto_base;    // Per non-terminal
+    vector<int32_t> goto_entries;
+    vector<int32_t> goto_check;
+    vector<int32_t> production_lhs;
+    vector<int32_t> production_length;
+
+    void build(const ParseTables &dense)
+    {
+        num_states = dense.num_states;
+        num_terminals = dense.num_terminals;
+        production_lhs = dense.production_lhs;
+        production_length = dense.production_length;
+
+        vector<vector<pair<int, int32_t>>> rows(num_states);
+        default_action.assign(num_states, encodeAction(ACTION_ERROR));
+        for (int state = 0; state < num_states; state++)
+        {
+            for (int term = 0; term < num_terminals; term++)
+            {
+                int32_t action = dense.action_at(state, term);
+                if (actionKind(action) != ACTION_ERROR)
+                    rows[state].push_back({term, action});
+            }
+            bool single_reduce = !rows[state].empty() && actionKind(rows[state][0].second) == ACTION_REDUCE;
+            for (const auto &[term, action] : rows[state])
+                single_reduce = single_reduce && action == rows[state][0].second;
+            if (single_reduce)
+            {
+                default_action[state] = rows[state][0].second;
+                rows[state].clear();
+            }
+        }
+        pack(rows, action_base, action_entries, action_check);
+
+        vector<vector<pair<int, int32_t>>> columns(dense.num_nonterminals);
+        default_goto.assign(dense.num_nonterminals, -1);
+        for (int nt = 0; nt < dense.num_nonterminals; nt++)
+        {
+            map<int32_t, int> frequency;
+            for (int state = 0; state < num_states; state++)
+            {
+                int32_t target = dense.goto_at(state, nt + num_terminals);
+                if (target >= 0)
+                    frequency[target]++;
+            }
+            int best = 0;
+            for (const auto &[target, count] : frequency)
+            {
+                if (count > best)
+                {
+                    best = count;
+                    default_goto[nt] = target;
+                }
+            }
+            for (int state = 0; state < num_states; state++)
+            {
+                int32_t target = dense.goto_at(state, nt + num_terminals);
+                if (target >= 0 && target != default_goto[nt])
+                    columns[nt].push_back({state, target});
+            }
+        }
+        pack(columns, goto_base, goto_entries, goto_check);
+    }
+
+    int32_t action_at(int state, int terminal) const
+    {
+        size_t i = action_base[state] + terminal;
+        return i < action_check.size() && action_check[i] == state ? action_entries[i] : default_action[state];
+    }
+
+    int32_t goto_at(int state, int nonterminal) const
+    {
+        int nt = nonterminal - num_terminals;
+        size_t i = goto_base[nt] + state;
+        return i < goto_check.size() && goto_check[i] == nt ? goto_entries[i] : default_goto[nt];
+    }
+
+    size_t bytes() const
+    {
+        size_t cells = default_action.size() + action_base.size() + action_entries.size() + action_check.size() +
+                       default_goto.size() + goto_base.size() + goto_entries.size() + goto_check.size() +
+                       production_lhs.size() + production_length.size();
+        return cells * sizeof(int32_t);
+    }
+
+private:
+    // First-fit row displacement, densest rows first.
+    static void pack(const vector<vector<pair<int, int32_t>>> &rows, vector<int32_t> &base,
+                     vector<int32_t> &entries, vector<int32_t> &check)
+    {
+        vector<int> order(rows.size());
+        for (size_t r = 0; r < rows.size(); r++)
+            order[r] = r;
+        stable_sort(order.begin(), order.end(), [&](int a, int b)
+                    { return rows[a].size() > rows[b].size(); });
+
+        base.assign(rows.size(), 0);
+        entries.clear();
+        check.clear();
+        for (int r : order)
+        {
+            if (rows[r].empty())
+                continue;
+            size_t offset = 0;
+            while (true)
+            {
+                bool fits = true;
+                for (const auto &[col, value] : rows[r])
+                {
+                    size_t i = offset + col;
+                    if (i < check.size() && check[i] >= 0)
+                    {
+                        fits = false;
+                        break;
+                    }
+                }
+                if (fits)
+                    break;
+                offset++;
+            }
+            base[r] = offset;
+            for (const auto &[col, value] : rows[r])
+            {
+                size_t i = offset + col;
+                if (i >= check.size())
+                {
+                    check.resize(i + 1, -1);
+                    entries.resize(i + 1, 0);
+                }
+                check[i] = r;
+                entries[i] = value;
+            }
+        }
+    }
+};
+
+enum TableMode
+{
+    TABLE_CLR,  // Canonical LR(1)
+    TABLE_LALR, // States with the same LR(0) core merged
+    TABLE_IELR  // Same-core states merged unless that adds a conflict
+};
+
+inline const char *tableModeName(TableMode mode)
+{
+    switch (mode)
+    {
+    case TABLE_LALR:
+        return "LALR(1)";
+    case TABLE_IELR:
+        return "IELR(1)";
+    default:
+        return "Canonical LR(1)";
+    }
+}
+
+struct ExpansionKey
+{
+    int nonterminal;
+    TerminalSet lookaheads;
+
+    bool operator==(const ExpansionKey &other) const
+    {
+        return nonterminal == other.nonterminal && lookaheads == other.lookaheads;
+    }
+};
+
+struct ExpansionKeyHash
+{
+    size_t operator()(const ExpansionKey &key) const
+    {
+        return key.lookaheads.hash() ^ ((uint64_t)key.nonterminal * 0x9e3779b97f4a7c15ULL);
+    }
+};
+
+struct ClosureStats
+{
+    size_t closure_calls = 0;
+    size_t expansion_lookups = 0; // One per kernel item with a non-terminal after the dot
+    size_t expansion_hits = 0;
+
+    void add(const ClosureStats &other)
+    {
+        closure_calls += other.closure_calls;
+        expansion_lookups += other.expansion_lookups;
+        expansion_hits += other.expansion_hits;
+    }
+};
+
+// Scratch space and the expansion cache used by closure(). Each builder
+// thread has its own, so closures never share mutable state.
+struct ClosureContext
+{
+    vector<int> core_slot;      // Item core -> position in the closure being built, or -1
+    vector<int> expansion_slot; // Item core -> position in the expansion being built, or -1
+    unordered_map<ExpansionKey, vector<LR1Item>, ExpansionKeyHash> expansion_cache;
+    ClosureStats stats;
+
+    explicit ClosureContext(int num_item_cores) : core_slot(num_item_cores, -1), expansion_slot(num_item_cores, -1) {}
+};
+
+// Kernel -> state, split into shards with a lock each so that builder threads
+// can look up and insert successor kernels concurrently. New kernels are
+// inserted unnumbered; the builder numbers them afterwards in a fixed order.
+class StateMap
+{
+public:
+    struct Entry
+    {
+        Kernel kernel;
+        int index = -1;
+    };
+
+    Entry *find_or_insert(Kernel &&kernel)
+    {
+        Shard &shard = shards[(kernel.hash * 0x9e3779b97f4a7c15ULL) >> (64 - SHARD_BITS)];
+        lock_guard<mutex> lock(shard.lock);
+        auto range = shard.entries.equal_range(kernel.hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second->kernel == kernel)
+                return it->second.get();
+        }
+        uint64_t hash = kernel.hash;
+        return shard.entries.emplace(hash, make_unique<Entry>(Entry{move(kernel)}))->second.get();
+    }
+
+private:
+    static const int SHARD_BITS = 6;
+    struct Shard
+    {
+        mutex lock;
+        unordered_multimap<uint64_t, unique_ptr<Entry>> entries;
+    };
+    Shard shards[1 << SHARD_BITS];
+};
+
+// Builds the canonical LR(1) collection and, for the LALR and IELR modes,
+// merges its states before the tables are filled in.
+class CanonicalLR1
+{
+public:
+    Grammar *grammar;
+    TableMode mode = TABLE_CLR;
+    vector<Kernel> states;
+    vector<map<int, int>> transitions;    // state -> symbol -> successor state
+    vector<vector<LR1Item>> reductions;   // state -> completed items of its closure
+    size_t canonical_state_count = 0;
+    int threads = 1; // Builder threads
+    ClosureStats stats;
+    ParseTables tables;
+    CompressedTables compressed; // Only filled in for --compress and --bench
+
+    void build(Grammar &g, TableMode table_mode = TABLE_CLR)
+    {
+        grammar = &g;
+        mode = table_mode;
+        explore();
+        canonical_state_count = states.size();
+
+        if (mode != TABLE_CLR)
+            merge_states();
+
+        tables.reset(states.size(), *grammar);
+        for (size_t state_idx = 0; state_idx < states.size(); ++state_idx)
+        {
+            for (const auto &[sym, target] : transitions[state_idx])
+            {
+                if (grammar->is_terminal(sym))
+                {
+                    tables.action_at(state_idx, sym) = encodeAction(ACTION_SHIFT, target);
+                }
+                else
+                {
+                    tables.goto_at(state_idx, sym) = target;
+                }
+            }
+            for (const auto &item : reductions[state_idx])
+            {
+                item.lookaheads.for_each([&](int la) { add_reduction(state_idx, item.prod, la); });
+            }
+        }
+    }
+
+    void add_reduction(int state_idx, int prod_idx, int la)
+    {
+        int32_t &cell = tables.action_at(state_idx, la);
+        if (grammar->productions[prod_idx].lhs == grammar->augmented_start && la == END_MARKER)
+        {
+            cell = encodeAction(ACTION_ACCEPT);
+            return;
+        }
+        int32_t reduce = encodeAction(ACTION_REDUCE, prod_idx);
+        if (cell != encodeAction(ACTION_ERROR) && cell != reduce)
+        {
+            cerr << "Conflict in action table!" << endl;
+        }
+        cell = reduce;
+    }
+
+    // Partitions the canonical states and replaces them with one state per
+    // block. Blocks start as the states sharing an LR(0) core (LALR). In IELR
+    // mode a block is first split wherever merging would create a conflict
+    // that none of its states has on its own. Blocks are then refined until
+    // every state in a block has its successors in the same blocks, so the
+    // merged automaton is deterministic.
+    void merge_states()
+    {
+        int n = states.size();
+        vector<int> block(n);
+        {
+            map<vector<pair<int, int>>, int> by_core;
+            for (int s = 0; s < n; s++)
+            {
+                vector<pair<int, int>> core;
+                for (const auto &item : states[s].items)
+                    core.push_back({item.prod, item.dot_pos});
+                block[s] = by_core.emplace(move(core), by_core.size()).first->second;
+            }
+        }
+
+        if (mode == TABLE_IELR)
+            split_conflicting_blocks(block);
+
+        int block_count = renumber(block);
+        while (true)
+        {
+            map<pair<int, vector<pair<int, int>>>, int> signature_ids;
+            vector<int> refined(n);
+            for (int s = 0; s < n; s++)
+            {
+                vector<pair<int, int>> successors;
+                for (const auto &[sym, target] : transitions[s])
+                    successors.push_back({sym, block[target]});
+                refined[s] = signature_ids.emplace(make_pair(block[s], move(successors)), signature_ids.size()).first->second;
+            }
+            block = move(refined);
+            if ((int)signature_ids.size() == block_count)
+                break;
+            block_count = signature_ids.size();
+        }
+
+        // Blocks are numbered in order of their first canonical state, so
+        // state 0 stays the start state. Merging is a union of lookaheads: the
+        // closure distributes over it, so reductions merge the same way.
+        vector<Kernel> merged_states;
+        vector<map<int, int>> merged_transitions;
+        vector<vector<LR1Item>> merged_reductions;
+        for (int s = 0; s < n; s++)
+        {
+            int b = block[s];
+            if (b == (int)merged_states.size())
+            {
+                merged_states.push_back(move(states[s]));
+                merged_transitions.emplace_back();
+                for (const auto &[sym, target] : transitions[s])
+                    merged_transitions[b][sym] = block[target];
+                merged_reductions.push_back(move(reductions[s]));
+                continue;
+            }
+            Kernel &kernel = merged_states[b];
+            for (size_t i = 0; i < kernel.items.size(); i++)
+                kernel.items[i].lookaheads.merge(states[s].items[i].lookaheads);
+            merge_reductions(merged_reductions[b], reductions[s]);
+        }
+        for (auto &kernel : merged_states)
+            kernel = Kernel(move(kernel.items));
+
+        states = move(merged_states);
+        transitions = move(merged_transitions);
+        reductions = move(merged_reductions);
+    }
+
+    // Splits each same-core block into groups whose union has no conflict
+    // beyond those its members already had. States join the first group
+    // they are compatible with, in canonical order.
+    void split_conflicting_blocks(vector<int> &block)
+    {
+        struct Group
+        {
+            vector<LR1Item> reductions;
+            TerminalSet own_conflicts;
+            int id;
+        };
+        map<int, vector<Group>> groups; // Same-core block -> its groups
+        int next_id = 0;
+        for (size_t s = 0; s < states.size(); s++)
+        {
+            TerminalSet shifts = shift_terminals(s);
+            TerminalSet own = conflicts(shifts, reductions[s]);
+            bool placed = false;
+            for (auto &group : groups[block[s]])
+            {
+                vector<LR1Item> merged = group.reductions;
+                merge_reductions(merged, reductions[s]);
+                TerminalSet allowed = group.own_conflicts;
+                allowed.merge(own);
+                if (!conflicts(shifts, merged).subset_of(allowed))
+                    continue;
+                group.reductions = move(merged);
+                group.own_conflicts = move(allowed);
+                block[s] = group.id;
+                placed = true;
+                break;
+            }
+            if (!placed)
+            {
+                groups[block[s]].push_back({reductions[s], own, next_id});
+                block[s] = next_id++;
+            }
+        }
+    }
+
+    TerminalSet shift_terminals(int state_idx) const
+    {
+        TerminalSet shifts(grammar->num_terminals);
+        for (const auto &[sym, target] : transitions[state_idx])
+        {
+            if (grammar->is_terminal(sym))
+                shifts.insert(sym);
+        }
+        return shifts;
+    }
+
+    // Terminals on which a state with these shifts and reductions has more
+    // than one action.
+    TerminalSet conflicts(const TerminalSet &shifts, const vector<LR1Item> &state_reductions) const
+    {
+        TerminalSet seen = shifts;
+        TerminalSet result(grammar->num_terminals);
+        for (const auto &item : state_reductions)
+        {
+            TerminalSet overlap = item.lookaheads;
+            overlap.intersect(seen);
+            result.merge(overlap);
+            seen.merge(item.lookaheads);
+        }
+        return result;
+    }
+
+    static void merge_reductions(vector<LR1Item> &into, const vector<LR1Item> &from)
+    {
+        for (const auto &item : from)
+        {
+            auto it = find_if(into.begin(), into.end(), [&](const LR1Item &other) { return other.same_core(item); });
+            if (it != into.end())
+                it->lookaheads.merge(item.lookaheads);
+            else
+                into.push_back(item);
+        }
+    }
+
+    // Renumbers block IDs densely in order of first appearance.
+    static int renumber(vector<int> &block)
+    {
+        unordered_map<int, int> ids;
+        for (int &b : block)
+            b = ids.emplace(b, ids.size()).first->second;
+        return ids.size();
+    }
+
+    // Builds the canonical collection breadth first, one frontier at a time.
+    // The states of a frontier are expanded in parallel; their successors are
+    // then numbered serially in frontier order and symbol order, which is the
+    // order a single FIFO queue would discover them in.
+    void explore()
+    {
+        StateMap state_map;
+        vector<StateMap::Entry *> numbered; // State -> its entry in state_map
+        vector<ClosureContext> contexts(max(1, threads), ClosureContext(grammar->num_item_cores()));
+
+        TerminalSet end_marker(grammar->num_terminals);
+        end_marker.insert(END_MARKER);
+        StateMap::Entry *start = state_map.find_or_insert(Kernel({LR1Item{0, 0, end_marker}}));
+        start->index = 0;
+        numbered.push_back(start);
+        transitions.emplace_back();
+        reductions.emplace_back();
+
+        vector<int> frontier = {0};
+        while (!frontier.empty())
+        {
+            vector<vector<pair<int, StateMap::Entry *>>> successors(frontier.size());
+            atomic<size_t> next_task{0};
+            auto work = [&](ClosureContext &ctx)
+            {
+                for (size_t i = next_task++; i < frontier.size(); i = next_task++)
+                    expand(frontier[i], numbered[frontier[i]]->kernel, state_map, successors[i], ctx);
+            };
+            if (contexts.size() == 1 || frontier.size() == 1)
+            {
+                work(contexts[0]);
+            }
+            else
+            {
+                vector<thread> workers;
+                for (auto &ctx : contexts)
+                    workers.emplace_back(work, ref(ctx));
+                for (auto &worker : workers)
+                    worker.join();
+            }
+
+            vector<int> next_frontier;
+            for (size_t i = 0; i < frontier.size(); i++)
+            {
+                for (const auto &[sym, entry] : successors[i])
+                {
+                    if (entry->index < 0)
+                    {
+                        entry->index = numbered.size();
+                        numbered.push_back(entry);
+                        transitions.emplace_back();
+                        reductions.emplace_back();
+                        next_frontier.push_back(entry->index);
+                    }
+                    transitions[frontier[i]][sym] = entry->index;
+                }
+            }
+            frontier = move(next_frontier);
+        }
+
+        states.reserve(numbered.size());
+        for (auto *entry : numbered)
+            states.push_back(move(entry->kernel));
+        for (const auto &ctx : contexts)
+            stats.add(ctx.stats);
+    }
+
+    // Closes one state, records its reductions and looks up (or inserts) the
+    // kernel of each successor. Runs on a builder thread; it writes only to
+    // this state's slots and to the sharded state map.
+    void expand(int state_idx, const Kernel &kernel, StateMap &state_map,
+                vector<pair<int, StateMap::Entry *>> &successors, ClosureContext &ctx)
+    {
+        vector<LR1Item> items = closure(kernel, ctx);
+
+        // Items grouped by the symbol after the dot, already advanced past
+        // it: the kernels of this state's successors.
+        map<int, vector<LR1Item>> moved;
+        for (auto &item : items)
+        {
+            const Production &prod = grammar->productions[item.prod];
+            if (item.dot_pos < (int)prod.rhs.size())
+                moved[prod.rhs[item.dot_pos]].push_back({item.prod, item.dot_pos + 1, item.lookaheads});
+            else
+                reductions[state_idx].push_back(move(item));
+        }
+
+        for (auto &[sym, kernel_items] : moved)
+            successors.push_back({sym, state_map.find_or_insert(Kernel(move(kernel_items)))});
+    }
+
+    // Kernel items followed by the items the closure adds, one per item core,
+    // with the lookaheads of each core merged. Closure distributes over its
+    // kernel items, so each kernel item contributes the (cached) expansion of
+    // the non-terminal after its dot.
+    vector<LR1Item> closure(const Kernel &kernel, ClosureContext &ctx) const
+    {
+        ctx.stats.closure_calls++;
+        vector<LR1Item> items = kernel.items;
+        for (size_t i = 0; i < items.size(); i++)
+            ctx.core_slot[grammar->item_core(items[i].prod, items[i].dot_pos)] = i;
+
+        TerminalSet lookaheads(grammar->num_terminals);
+        for (const auto &item : kernel.items)
+        {
+            int B = next_nonterminal(item, lookaheads);
+            if (B < 0)
+                continue;
+            for (const auto &added : expansion(B, lookaheads, ctx))
+            {
+                int &slot = ctx.core_slot[grammar->item_core(added.prod, added.dot_pos)];
+                if (slot < 0)
+                {
+                    slot = items.size();
+                    items.push_back(added);
+                }
+                else
+                {
+                    items[slot].lookaheads.merge(added.lookaheads);
+                }
+            }
+        }
+
+        for (const auto &item : items)
+            ctx.core_slot[grammar->item_core(item.prod, item.dot_pos)] = -1;
+        return items;
+    }
+
+    // If the item's dot is before a non-terminal B, returns B and sets
+    // lookaheads to what may follow B there; otherwise returns -1.
+    int next_nonterminal(const LR1Item &item, TerminalSet &lookaheads) const
+    {
+        const Production &prod = grammar->productions[item.prod];
+        if (item.dot_pos >= (int)prod.rhs.size() || grammar->is_terminal(prod.rhs[item.dot_pos]))
+            return -1;
+        // EPSILON in FIRST(beta) means the item's own lookaheads follow.
+        const TerminalSet &first_beta = grammar->first_of_suffix(item.prod, item.dot_pos + 1);
+        lookaheads.clear();
+        lookaheads.merge(first_beta, false);
+        if (first_beta.contains(EPSILON))
+            lookaheads.merge(item.lookaheads);
+        return prod.rhs[item.dot_pos];
+    }
+
+    // Every item the closure adds for B with the given lookaheads, one per
+    // item core. Computed once per (B, lookaheads) pair.
+    const vector<LR1Item> &expansion(int B, const TerminalSet &lookaheads, ClosureContext &ctx) const
+    {
+        ctx.stats.expansion_lookups++;
+        auto it = ctx.expansion_cache.find({B, lookaheads});
+        if (it != ctx.expansion_cache.end())
+        {
+            ctx.stats.expansion_hits++;
+            return it->second;
+        }
+
+        vector<LR1Item> items;
+        vector<int> worklist;
+        auto add = [&](int p, const TerminalSet &la)
+        {
+            int &slot = ctx.expansion_slot[grammar->item_core(p, 0)];
+            if (slot < 0)
+            {
+                slot = items.size();
+                items.push_back({p, 0, la});
+                worklist.push_back(slot);
+            }
+            else if (items[slot].lookaheads.merge(la))
+            {
+                worklist.push_back(slot);
+            }
+        };
+        for (int p : grammar->productions_of[B])
+            add(p, lookaheads);
+
+        TerminalSet follow(grammar->num_terminals);
+        while (!worklist.empty())
+        {
+            int i = worklist.back();
+            worklist.pop_back();
+            int C = next_nonterminal(items[i], follow);
+            if (C < 0)
+                continue;
+            for (int p : grammar->productions_of[C])
+                add(p, follow);
+        }
+
+        for (const auto &item : items)
+            ctx.expansion_slot[grammar->item_core(item.prod, 0)] = -1;
+        return ctx.expansion_cache.emplace(ExpansionKey{B, lookaheads}, move(items)).first->second;
+    }
+
+    void write_item_sets(const string &filename)
+    {
+        ofstream file(filename);
+        ClosureContext ctx(grammar->num_item_cores());
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            file << "State " << i << ":\n";
+            // Print items
+            for (const auto &item : closure(states[i], ctx))
+            {
+                const Production &prod = grammar->productions[item.prod];
+                file << "  ";
+                file << grammar->name(prod.lhs) << " -> ";
+                for (size_t j = 0; j < prod.rhs.size(); j++)
+                {
+                    if ((int)j == item.dot_pos)
+                        file << ". ";
+                    file << grammar->name(prod.rhs[j]) << " ";
+                }
+                if (item.dot_pos == (int)prod.rhs.size())
+                    file << ". ";
+                file << "[";
+                const char *sep = "";
+                item.lookaheads.for_each([&](int la) { file << sep << grammar->name(la); sep = "/"; });
+                file << "]\n";
+            }
+
+            // Print transitions
+            file << "\n  Transitions:\n";
+            for (const auto &[sym, state] : transitions[i])
+            {
+                file << "    " << grammar->name(sym) << " -> " << state << "\n";
+            }
+            file << "------------------------\n";
+        }
+    }
+
+    void write_parsing_table(const string &filename)
+    {
+        ofstream file(filename);
+        file << "Parsing Table (" << tableModeName(mode) << ", " << tables.num_states << " states):\n";
+        file << "State\tAction\n";
+        for (int state = 0; state < tables.num_states; state++)
+        {
+            string row;
+            for (int term = 0; term < tables.num_terminals; term++)
+            {
+                int32_t action = tables.action_at(state, term);
+                if (actionKind(action) != ACTION_ERROR)
+                    row += grammar->name(term) + ":" + actionToString(action) + " ";
+            }
+            if (!row.empty())
+                file << state << "\t" << row << "\n";
+        }
+
+        file << "\nGoto Table:\n";
+        for (int state = 0; state < tables.num_states; state++)
+        {
+            string row;
+            for (int nonterm = tables.num_terminals; nonterm < tables.num_terminals + tables.num_nonterminals; nonterm++)
+            {
+                int32_t dest = tables.goto_at(state, nonterm);
+                if (dest >= 0)
+                    row += grammar->name(nonterm) + ":" + to_string(dest) + " ";
+            }
+            if (!row.empty())
+                file << state << "\t" << row << "\n";
+        }
+    }
+};
+
+// Built tables saved next to the grammar file (<grammar>.<mode>.tables) so
+// later runs can skip grammar analysis and table construction. The file is
+// keyed by a hash of the grammar text, the table mode and the format version;
+// a file with any other key is ignored and rewritten.
+//
+// Layout (host byte order):
+//   TableCacheHeader
+//   symbol names, NUL-terminated, padded to 4 bytes
+//   int32 production_lhs[productions], production_length[productions]
+//   int32 rhs[rhs_symbols] (all right-hand sides back to back)
+//   int32 action[states * terminals], goto[states * non-terminals]
+// checksum is FNV-1a over everything after the header.
+const char TABLE_CACHE_MAGIC[4] = {'L', 'R', 'T', 'C'};
+const uint16_t TABLE_CACHE_VERSION = 2;
+
+struct TableCacheHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t mode;
+    uint64_t key;
+    uint32_t num_symbols;
+    uint32_t num_terminals;
+    uint32_t num_productions;
+    uint32_t rhs_symbols;
+    uint32_t num_states;
+    uint32_t canonical_states;
+    uint32_t names_bytes;
+    uint32_t checksum;
+};
+
+static_assert(sizeof(TableCacheHeader) == 48, "table cache header must stay 48 bytes");
+
+class TableCache
+{
+public:
+    static string path(const string &grammar_file, TableMode mode)
+    {
+        static const char *suffix[] = {".clr.tables", ".lalr.tables", ".ielr.tables"};
+        return grammar_file + suffix[mode];
+    }
+
+    // FNV-1a over the grammar text, the mode and the format version. Returns
+    // 0 (never a valid key) if the grammar cannot be read.
+    static uint64_t key(const string &grammar_file, TableMode mode)
+    {
+        try
+        {
+            SourceBuffer text(grammar_file);
+            uint64_t h = 0xcbf29ce484222325ULL;
+            for (unsigned char c : text.view())
+                h = (h ^ c) * 0x100000001b3ULL;
+            h = (h ^ mode) * 0x100000001b3ULL;
+            h = (h ^ TABLE_CACHE_VERSION) * 0x100000001b3ULL;
+            return h | 1;
+        }
+        catch (const exception &)
+        {
+            return 0;
+        }
+    }
+
+    static uint32_t checksum(uint32_t h, const void *data, size_t bytes)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < bytes; i++)
+            h = (h ^ p[i]) * 16777619u;
+        return h;
+    }
+
+    // Restores the grammar's symbols and productions and the dense tables.
+    // FIRST/FOLLOW and the LR(1) states are not restored. Returns false, with
+    // grammar and clr untouched, for a file that is stale, corrupt or
+    // inconsistent; the caller then rebuilds.
+    static bool load(const string &filename, uint64_t key, TableMode mode, Grammar &grammar, CanonicalLR1 &clr)
+    {
+        try
+        {
+            SourceBuffer file(filename);
+            string_view data = file.view();
+            TableCacheHeader header;
+            if (data.size() < sizeof(header))
+                return false;
+            memcpy(&header, data.data(), sizeof(header));
+            if (memcmp(header.magic, TABLE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+                header.version != TABLE_CACHE_VERSION || header.mode != mode || header.key != key)
+                return false;
+
+            if (header.num_terminals > header.num_symbols || header.num_productions == 0 || header.names_bytes == 0 ||
+                header.num_states == 0)
+                return false;
+            size_t num_nonterminals = header.num_symbols - header.num_terminals;
+            size_t names_size = (header.names_bytes + 3) & ~(size_t)3;
+            size_t cells = 2 * (size_t)header.num_productions + header.rhs_symbols +
+                           (size_t)header.num_states * header.num_symbols;
+            if (data.size() != sizeof(header) + names_size + cells * sizeof(int32_t))
+                return false;
+            if (checksum(2166136261u, data.data() + sizeof(header), data.size() - sizeof(header)) != header.checksum)
+                return false;
+
+            const char *names = data.data() + sizeof(header);
+            const int32_t *cell = reinterpret_cast<const int32_t *>(names + names_size);
+            if (names[header.names_bytes - 1] != '\0')
+                return false;
+
+            // The sizes above only bound the file as a whole; the productions
+            // must also tile the rhs block exactly before anything is sliced.
+            const int32_t *lhs = cell;
+            const int32_t *length = cell + header.num_productions;
+            const int32_t *rhs = length + header.num_productions;
+            uint64_t rhs_total = 0;
+            for (size_t p = 0; p < header.num_productions; p++)
+            {
+                if (lhs[p] < (int32_t)header.num_terminals || lhs[p] >= (int32_t)header.num_symbols || length[p] < 0)
+                    return false;
+                rhs_total += length[p];
+            }
+            if (rhs_total != header.rhs_symbols)
+                return false;
+            for (size_t i = 0; i < header.rhs_symbols; i++)
+                if (rhs[i] <= EPSILON || rhs[i] >= (int32_t)header.num_symbols)
+                    return false;
+
+            // Every table cell must stay inside the tables the parser indexes.
+            const int32_t *action = rhs + header.rhs_symbols;
+            const int32_t *goto_cells = action + (size_t)header.num_states * header.num_terminals;
+            for (size_t i = 0; i < (size_t)header.num_states * header.num_terminals; i++)
+            {
+                int value = actionValue(action[i]);
+                switch (actionKind(action[i]))
+                {
+                case ACTION_SHIFT:
+                    if (value < 0 || value >= (int32_t)header.num_states)
+                        return false;
+                    break;
+                case ACTION_REDUCE:
+                    if (value < 0 || value >= (int32_t)header.num_productions)
+                        return false;
+                    break;
+                default:
+                    if (value != 0)
+                        return false;
+                }
+            }
+            for (size_t i = 0; i < (size_t)header.num_states * num_nonterminals; i++)
+                if (goto_cells[i] < -1 || goto_cells[i] >= (int32_t)header.num_states)
+                    return false;
+
+            auto take = [&](size_t n)
+            {
+                vector<int32_t> values(cell, cell + n);
+                cell += n;
+                return values;
+            };
+
+            if ((size_t)count(names, names + header.names_bytes, '\0') != header.num_symbols)
+                return false;
+
+            grammar = Grammar();
+            for (const char *name = names; name < names + header.names_bytes; name += strlen(name) + 1)
+            {
+                grammar.symbol_ids.emplace(name, grammar.symbol_names.size());
+                grammar.symbol_names.push_back(name);
+            }
+            grammar.num_terminals = header.num_terminals;
+
+            ParseTables &tables = clr.tables;
+            tables.num_states = header.num_states;
+            tables.num_terminals = header.num_terminals;
+            tables.num_nonterminals = num_nonterminals;
+            tables.production_lhs = take(header.num_productions);
+            tables.production_length = take(header.num_productions);
+            for (size_t p = 0; p < header.num_productions; p++)
+            {
+                Production prod;
+                prod.lhs = tables.production_lhs[p];
+                prod.rhs = take(tables.production_length[p]);
+                prod.id = p;
+                grammar.productions.push_back(move(prod));
+            }
+            grammar.augmented_start = grammar.start_symbol = grammar.productions[0].lhs;
+            tables.action = take((size_t)header.num_states * header.num_terminals);
+            tables.goto_state = take((size_t)header.num_states * num_nonterminals);
+
+            clr.grammar = &grammar;
+            clr.mode = mode;
+            clr.canonical_state_count = header.canonical_states;
+            return true;
+        }
+        catch (const exception &)
+        {
+            return false;
+        }
+    }
+
+    // Writes to a temporary file and renames it into place, so a concurrent
+    // run never maps a half-written cache.
+    static void save(const string &filename, uint64_t key, TableMode mode, const Grammar &grammar,
+                     const CanonicalLR1 &clr)
+    {
+        const ParseTables &tables = clr.tables;
+        string names;
+        for (const auto &name : grammar.symbol_names)
+        {
+            names += name;
+            names += '\0';
+        }
+
+        TableCacheHeader header{};
+        memcpy(header.magic, TABLE_CACHE_MAGIC, sizeof(header.magic));
+        header.version = TABLE_CACHE_VERSION;
+        header.mode = mode;
+        header.key = key;
+        header.num_symbols = grammar.symbol_names.size();
+        header.num_terminals = grammar.num_terminals;
+        header.num_productions = grammar.productions.size();
+        for (const auto &prod : grammar.productions)
+            header.rhs_symbols += prod.rhs.size();
+        header.num_states = tables.num_states;
+        header.canonical_states = clr.canonical_state_count;
+        header.names_bytes = names.size();
+        names.resize((names.size() + 3) & ~(size_t)3, '\0');
+
+        string temp = filename + ".tmp";
+        {
+            ofstream file(temp, ios::binary | ios::trunc);
+            if (!file.is_open())
+                return;
+            uint32_t sum = 2166136261u;
+            auto write = [&](const void *data, size_t bytes)
+            {
+                file.write(static_cast<const char *>(data), bytes);
+                sum = checksum(sum, data, bytes);
+            };
+            auto write_cells = [&](const vector<int32_t> &cells)
+            {
+                write(cells.data(), cells.size() * sizeof(int32_t));
+            };
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header)); // Checksum patched in below
+            write(names.data(), names.size());
+            write_cells(tables.production_lhs);
+            write_cells(tables.production_length);
+            for (const auto &prod : grammar.productions)
+                write_cells(vector<int32_t>(prod.rhs.begin(), prod.rhs.end()));
+            write_cells(tables.action);
+            write_cells(tables.goto_state);
+            header.checksum = sum;
+            file.seekp(0);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            if (!file)
+                return;
+        }
+        rename(temp.c_str(), filename.c_str());
+    }
+};
+
+// Fills grammar and clr for grammar_file, from the table cache when it is
+// current, otherwise by building them (and refreshing the cache). Returns
+// whether the tables came from the cache. Throws if the grammar file cannot be
+// read.
+inline bool load_tables(const string &grammar_file, TableMode mode, bool use_cache, int threads,
+                        Grammar &grammar, CanonicalLR1 &clr)
+{
+    string cache_file = TableCache::path(grammar_file, mode);
+    uint64_t cache_key = use_cache ? TableCache::key(grammar_file, mode) : 0;
+    if (cache_key && TableCache::load(cache_file, cache_key, mode, grammar, clr))
+        return true;
+    grammar.load(grammar_file);
+    clr.threads = threads;
+    clr.build(grammar, mode);
+    if (cache_key)
+        TableCache::save(cache_file, cache_key, mode, grammar, clr);
+    return false;
+}
+
+enum TraceLevel
+{
+    TRACE_OFF,     // No trace output
+    TRACE_ACTIONS, // One "Action:" line per step in parsing_steps.txt
+    TRACE_FULL     // Binary event log in parsing_trace.bin
+};
+
+// Binary parse trace (host byte order):
+//   TraceHeader
+//   name_count input names, NUL-terminated, padded to 4 bytes
+//   int32 production_length[num_productions]
+//   int32 input[input_count] (indices into the names; the last one is "$")
+//   TraceEvent per step, up to the end of the file
+// decode_trace turns it back into the Stack/Input/Action text of
+// parsing_steps.txt by replaying the stack.
+const char TRACE_MAGIC[4] = {'L', 'R', 'T', 'R'};
+const uint16_t TRACE_VERSION = 1;
+
+struct TraceHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t name_count;
+    uint32_t names_bytes;
+    uint32_t num_productions;
+    uint32_t input_count;
+};
+
+struct TraceEvent
+{
+    int32_t state;      // State on top of the stack
+    uint32_t pos;       // Input position
+    int32_t action;     // Encoded action, ACTION_ERROR for an unknown token
+    int32_t next_state; // State pushed by a shift or the goto of a reduce, -1 if none
+};
+
+static_assert(sizeof(TraceHeader) == 24, "trace header must stay 24 bytes");
+static_assert(sizeof(TraceEvent) == 16, "trace events must stay 16 bytes");
+
+// Buffers events and writes them in large blocks.
+class TraceWriter
+{
+    ofstream file;
+    vector<TraceEvent> buffer;
+    static const size_t BLOCK_EVENTS = 4096;
+
+public:
+    ~TraceWriter() { close(); }
+
+    void open(const string &filename, const vector<string> &names, const vector<int32_t> &production_length)
+    {
+        close();
+        file.open(filename, ios::binary | ios::trunc);
+        buffer.reserve(BLOCK_EVENTS);
+
+        unordered_map<string, int32_t> name_ids;
+        string name_table;
+        vector<int32_t> input;
+        for (const auto &name : names)
+        {
+            auto [it, inserted] = name_ids.emplace(name, name_ids.size());
+            if (inserted)
+            {
+                name_table += name;
+                name_table += '\0';
+            }
+            input.push_back(it->second);
+        }
+
+        TraceHeader header{};
+        memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_VERSION;
+        header.name_count = name_ids.size();
+        header.names_bytes = name_table.size();
+        header.num_productions = production_length.size();
+        header.input_count = input.size();
+        name_table.resize((name_table.size() + 3) & ~(size_t)3, '\0');
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(name_table.data(), name_table.size());
+        file.write(reinterpret_cast<const char *>(production_length.data()), production_length.size() * sizeof(int32_t));
+        file.write(reinterpret_cast<const char *>(input.data()), input.size() * sizeof(int32_t));
+    }
+
+    void record(int state, size_t pos, int32_t action, int next_state)
+    {
+        buffer.push_back({state, (uint32_t)pos, action, next_state});
+        if (buffer.size() == BLOCK_EVENTS)
+            flush();
+    }
+
+    void close()
+    {
+        if (!file.is_open())
+            return;
+        flush();
+        file.close();
+    }
+
+private:
+    void flush()
+    {
+        file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(TraceEvent));
+        buffer.clear();
+    }
+};
+
+// Writes the text form of a binary trace, in the format parsing_steps.txt
+// always had.
+inline void decode_trace(const string &filename, ostream &out)
+{
+    SourceBuffer file(filename);
+    string_view data = file.view();
+    TraceHeader header;
+    if (data.size() < sizeof(header) || memcmp(data.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+        throw runtime_error(filename + " is not a parse trace");
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.version != TRACE_VERSION)
+        throw runtime_error("Unsupported parse trace version in " + filename);
+
+    size_t names_size = (header.names_bytes + 3) & ~(size_t)3;
+    size_t events_start = sizeof(header) + names_size + ((size_t)header.num_productions + header.input_count) * sizeof(int32_t);
+    if (data.size() < events_start)
+        throw runtime_error("Truncated parse trace " + filename);
+
+    vector<string> names;
+    const char *name_table = data.data() + sizeof(header);
+    for (const char *name = name_table; name < name_table + header.names_bytes; name += strlen(name) + 1)
+        names.push_back(name);
+    vector<int32_t> production_length(header.num_productions);
+    vector<int32_t> input(header.input_count);
+    const char *cells = name_table + names_size;
+    memcpy(production_length.data(), cells, production_length.size() * sizeof(int32_t));
+    memcpy(input.data(), cells + production_length.size() * sizeof(int32_t), input.size() * sizeof(int32_t));
+
+    out << "Parsing Steps:\n";
+    vector<int> stack = {0};
+    size_t count = (data.size() - events_start) / sizeof(TraceEvent);
+    for (size_t e = 0; e < count; e++)
+    {
+        TraceEvent event;
+        memcpy(&event, data.data() + events_start + e * sizeof(TraceEvent), sizeof(event));
+
+        out << "Stack: ";
+        for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+            out << *it << " ";
+        out << "\nInput: ";
+        for (size_t i = event.pos; i < input.size(); i++)
+            out << names[input[i]] << " ";
+        out << "\n";
+
+        ActionKind kind = actionKind(event.action);
+        if (kind == ACTION_REDUCE)
+            stack.resize(stack.size() - production_length[actionValue(event.action)]);
+        if ((kind != ACTION_SHIFT && kind != ACTION_REDUCE) || event.next_state < 0)
+            break;
+        stack.push_back(event.next_state);
+        out << "Action: " << actionToString(event.action) << "\n\n";
+    }
+}
+
+enum ParseStatus
+{
+    PARSE_CONTINUE, // Token consumed, more input expected
+    PARSE_ACCEPT,
+    PARSE_ERROR
+};
+
+// Receives the parser's shifts and reductions, e.g. to build a tree (see
+// ast.h). These do nothing, so plain parsing compiles to the bare loop.
+struct NoActions
+{
+    void shift() {}
+    void reduce(int) {}
+};
+
+// LR driver over terminal IDs with an int state stack. A Parser can be reused
+// for any number of inputs: begin() only clears the stack, so once it has
+// grown to the deepest nesting seen, parsing makes no heap allocations.
+class Parser
+{
+public:
+    CanonicalLR1 &clr;
+    bool use_compressed = false;
+    TraceLevel trace;
+
+    Parser(CanonicalLR1 &clr, TraceLevel trace = TRACE_OFF) : clr(clr), trace(trace)
+    {
+        stack.reserve(256);
+        begin();
+        if (trace == TRACE_ACTIONS)
+        {
+            step_file.open("parsing_steps.txt");
+            step_file << "Parsing Steps:\n";
+        }
+    }
+
+    // Starts a new input.
+    void begin()
+    {
+        stack.clear();
+        stack.push_back(0);
+        pos = 0;
+        status = PARSE_CONTINUE;
+    }
+
+    // Feeds one terminal ID; the input ends with END_MARKER. Performs every
+    // reduction the token triggers, then shifts it (or accepts or fails).
+    ParseStatus push(int token)
+    {
+        NoActions none;
+        return push(token, none);
+    }
+
+    // As push(token), also reporting each shift and each reduction (by
+    // production index, before its states are popped) to actions.
+    template <typename Actions>
+    ParseStatus push(int token, Actions &actions)
+    {
+        if (status != PARSE_CONTINUE)
+            return status;
+        return use_compressed ? step_traced(clr.compressed, token, actions) : step_traced(clr.tables, token, actions);
+    }
+
+    // Parses a whole input of terminal IDs. The final END_MARKER acts as a
+    // sentinel: it always ends in accept or error, so the loop needs no
+    // bounds check.
+    bool parse(const vector<int> &tokens)
+    {
+        begin();
+        if (tokens.empty() || tokens.back() != END_MARKER)
+            return false;
+        return use_compressed ? run_traced(clr.compressed, tokens.data()) : run_traced(clr.tables, tokens.data());
+    }
+
+    // With TRACE_FULL, starts parsing_trace.bin for the next parse(); names
+    // are the input's token names, "$" included, as decode_trace prints them.
+    void open_trace(const vector<string> &names)
+    {
+        if (trace == TRACE_FULL)
+            trace_file.open("parsing_trace.bin", names, clr.tables.production_length);
+    }
+
+    const vector<int> &states() const { return stack; }
+
+private:
+    vector<int> stack; // LR states, start state at the bottom
+    size_t pos = 0;    // Tokens shifted so far
+    ParseStatus status = PARSE_CONTINUE;
+    ofstream step_file;     // TRACE_ACTIONS
+    TraceWriter trace_file; // TRACE_FULL
+
+    template <typename Tables>
+    bool run_traced(const Tables &tables, const int *tokens)
+    {
+        switch (trace)
+        {
+        case TRACE_FULL:
+            return run<TRACE_FULL>(tables, tokens);
+        case TRACE_ACTIONS:
+            return run<TRACE_ACTIONS>(tables, tokens);
+        default:
+            return run<TRACE_OFF>(tables, tokens);
+        }
+    }
+
+    template <typename Tables, typename Actions>
+    ParseStatus step_traced(const Tables &tables, int token, Actions &actions)
+    {
+        switch (trace)
+        {
+        case TRACE_FULL:
+            return step<TRACE_FULL>(tables, token, actions);
+        case TRACE_ACTIONS:
+            return step<TRACE_ACTIONS>(tables, token, actions);
+        default:
+            return step<TRACE_OFF>(tables, token, actions);
+        }
+    }
+
+    template <TraceLevel level, typename Tables>
+    bool run(const Tables &tables, const int *tokens)
+    {
+        NoActions none;
+        ParseStatus result;
+        while ((result = step<level>(tables, *tokens, none)) == PARSE_CONTINUE)
+            tokens++;
+        return result == PARSE_ACCEPT;
+    }
+
+    // The trace level is a template argument so that TRACE_OFF compiles to
+    // the bare loop.
+    template <TraceLevel level, typename Tables, typename Actions>
+    ParseStatus step(const Tables &tables, int token, Actions &actions)
+    {
+        if (token < 0)
+        {
+            if constexpr (level == TRACE_FULL)
+                trace_file.record(stack.back(), pos, encodeAction(ACTION_ERROR), -1);
+            return status = PARSE_ERROR;
+        }
+
+        while (true)
+        {
+            int current_state = stack.back();
+            int32_t action = tables.action_at(current_state, token);
+            int next_state = -1;
+            switch (actionKind(action))
+            {
+            case ACTION_SHIFT:
+                next_state = actionValue(action);
+                break;
+            case ACTION_REDUCE:
+            {
+                int prod_idx = actionValue(action);
+                actions.reduce(prod_idx);
+                stack.resize(stack.size() - tables.production_length[prod_idx]);
+                next_state = tables.goto_at(stack.back(), tables.production_lhs[prod_idx]);
+                break;
+            }
+            default:
+                break;
+            }
+
+            if constexpr (level == TRACE_FULL)
+                trace_file.record(current_state, pos, action, next_state);
+            if (actionKind(action) == ACTION_ACCEPT)
+                return status = PARSE_ACCEPT;
+            if (next_state < 0)
+                return status = PARSE_ERROR;
+            stack.push_back(next_state);
+            if constexpr (level == TRACE_ACTIONS)
+                step_file << "Action: " << actionToString(action) << "\n";
+            if (actionKind(action) == ACTION_SHIFT)
+            {
+                actions.shift();
+                pos++;
+                return PARSE_CONTINUE;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+// Token vocabulary shared by the lexer and the parser, plus the binary token
+// stream the lexer writes to <input>.parse and the parser reads back.
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LEXER_HAVE_MMAP 1
+#endif
+
+struct Position
+{
+    int line;
+    int column;
+    Position(int l = 1, int c = 1) : line(l), column(c) {}
+};
+
+enum TokenType
+{
+    TOKEN_INT,
+    TOKEN_FLOAT,
+    TOKEN_VOID,
+    TOKEN_IF,
+    TOKEN_ELSE,
+    TOKEN_READ,
+    TOKEN_PRINT,
+    TOKEN_ID,
+    TOKEN_INT_LIT,
+    TOKEN_FLOAT_LIT,
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_MULTIPLY,
+    TOKEN_DIVIDE,
+    TOKEN_MOD,
+    TOKEN_INCREMENT,
+    TOKEN_LT,
+    TOKEN_GT,
+    TOKEN_EQ,
+    TOKEN_EQUALS,
+    TOKEN_LBRACE,
+    TOKEN_RBRACE,
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
+    TOKEN_SEMICOLON,
+    TOKEN_COMMA,
+    TOKEN_RETURN,
+    TOKEN_EOF,
+    TOKEN_ERROR
+};
+
+inline const char *tokenTypeToString(TokenType type)
+{
+    switch (type)
+    {
+    case TOKEN_INT:
+        return "INT";
+    case TOKEN_FLOAT:
+        return "FLOAT";
+    case TOKEN_VOID:
+        return "VOID";
+    case TOKEN_IF:
+        return "IF";
+    case TOKEN_ELSE:
+        return "ELSE";
+    case TOKEN_READ:
+        return "READ";
+    case TOKEN_PRINT:
+        return "PRINT";
+    case TOKEN_ID:
+        return "ID";
+    case TOKEN_INT_LIT:
+        return "INT_LIT";
+    case TOKEN_FLOAT_LIT:
+        return "FLOAT_LIT";
+    case TOKEN_PLUS:
+        return "PLUS";
+    case TOKEN_MINUS:
+        return "MINUS";
+    case TOKEN_MULTIPLY:
+        return "MULTIPLY";
+    case TOKEN_DIVIDE:
+        return "DIVIDE";
+    case TOKEN_MOD:
+        return "MOD";
+    case TOKEN_INCREMENT:
+        return "INCREMENT";
+    case TOKEN_LT:
+        return "LT";
+    case TOKEN_GT:
+        return "GT";
+    case TOKEN_EQ:
+        return "EQ";
+    case TOKEN_EQUALS:
+        return "EQUALS";
+    case TOKEN_LBRACE:
+        return "LBRACE";
+    case TOKEN_RBRACE:
+        return "RBRACE";
+    case TOKEN_LPAREN:
+        return "LPAREN";
+    case TOKEN_RPAREN:
+        return "RPAREN";
+    case TOKEN_SEMICOLON:
+        return "SEMICOLON";
+    case TOKEN_COMMA:
+        return "COMMA";
+    case TOKEN_EOF:
+        return "EOF";
+    case TOKEN_RETURN:
+        return "RETURN";
+    default:
+        return "ERROR";
+    }
+}
+
+inline std::string positionToString(const Position &pos)
+{
+    return std::to_string(pos.line) + ":" + std::to_string(pos.column);
+}
+
+// Read-only contents of a file. The file is memory-mapped when the platform
+// supports it, otherwise it is read into an owned buffer. Lexemes handed out
+// by the Lexer are views into this buffer, so it must outlive them.
+class SourceBuffer
+{
+    const char *data = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::string owned;
+
+public:
+    explicit SourceBuffer(const std::string &filename)
+    {
+#ifdef LEXER_HAVE_MMAP
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open input file " + filename);
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            length = st.st_size;
+            if (length == 0)
+            {
+                close(fd);
+                return;
+            }
+            void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                madvise(addr, length, MADV_SEQUENTIAL);
+                data = static_cast<const char *>(addr);
+                mapped = true;
+                close(fd);
+                return;
+            }
+        }
+        close(fd);
+#endif
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open())
+            throw std::runtime_error("Cannot open input file " + filename);
+        owned.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = owned.data();
+        length = owned.size();
+    }
+
+    ~SourceBuffer()
+    {
+#ifdef LEXER_HAVE_MMAP
+        if (mapped)
+            munmap(const_cast<char *>(data), length);
+#endif
+    }
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+    std::string_view view() const { return std::string_view(data, length); }
+};
+
+// Binary token stream layout (host byte order):
+//   TokenStreamHeader
+//   token_count x TokenRecord
+// offset/length locate the lexeme in the source file the stream was made from.
+const char TOKEN_STREAM_MAGIC[4] = {'L', 'X', 'T', 'S'};
+const uint16_t TOKEN_STREAM_VERSION = 1;
+
+struct TokenStreamHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t kind_count; // Number of TokenType codes known to the writer
+    uint32_t reserved;
+    uint64_t token_count;
+    uint64_t source_size;
+};
+
+struct TokenRecord
+{
+    uint64_t offset;
+    uint32_t length;
+    uint32_t line;
+    uint32_t column;
+    uint16_t kind; // TokenType
+    uint16_t reserved;
+};
+
+static_assert(sizeof(TokenStreamHeader) == 32, "token stream header must stay 32 bytes");
+static_assert(sizeof(TokenRecord) == 24, "token records must stay 24 bytes");
+
+// Buffers records and writes them out in large blocks. The token count in the
+// header is patched in by close().
+class TokenStreamWriter
+{
+    std::ofstream file;
+    std::vector<TokenRecord> buffer;
+    uint64_t token_count = 0;
+    uint64_t source_size;
+    static const size_t BLOCK_RECORDS = 8192;
+
+public:
+    TokenStreamWriter(const std::string &filename, uint64_t source_size = 0)
+        : file(filename, std::ios::binary | std::ios::trunc), source_size(source_size)
+    {
+        buffer.reserve(BLOCK_RECORDS);
+        writeHeader();
+    }
+
+    ~TokenStreamWriter() { close(); }
+
+    bool is_open() const { return file.is_open(); }
+
+    void write(TokenType type, uint64_t offset, uint32_t length, Position pos)
+    {
+        TokenRecord record{};
+        record.offset = offset;
+        record.length = length;
+        record.line = pos.line;
+        record.column = pos.column;
+        record.kind = static_cast<uint16_t>(type);
+        buffer.push_back(record);
+        token_count++;
+        if (buffer.size() == BLOCK_RECORDS)
+            flush();
+    }
+
+    void setSourceSize(uint64_t size) { source_size = size; }
+
+    void close()
+    {
+        if (!file.is_open())
+            return;
+        flush();
+        file.seekp(0);
+        writeHeader();
+        file.close();
+    }
+
+private:
+    void writeHeader()
+    {
+        TokenStreamHeader header{};
+        memcpy(header.magic, TOKEN_STREAM_MAGIC, sizeof(header.magic));
+        header.version = TOKEN_STREAM_VERSION;
+        header.record_size = sizeof(TokenRecord);
+        header.kind_count = TOKEN_ERROR + 1;
+        header.token_count = token_count;
+        header.source_size = source_size;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    void flush()
+    {
+        if (buffer.empty())
+            return;
+        file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(TokenRecord));
+        buffer.clear();
+    }
+};
+
+// Maps a token stream file and exposes its records in place.
+class TokenStreamReader
+{
+    SourceBuffer file;
+    const TokenRecord *records = nullptr;
+    size_t count = 0;
+
+public:
+    explicit TokenStreamReader(const std::string &filename) : file(filename)
+    {
+        std::string_view data = file.view();
+        if (!isTokenStream(data))
+            throw std::runtime_error(filename + " is not a token stream");
+        TokenStreamHeader header;
+        memcpy(&header, data.data(), sizeof(header));
+        if (header.version != TOKEN_STREAM_VERSION || header.record_size != sizeof(TokenRecord) ||
+            header.kind_count != TOKEN_ERROR + 1)
+            throw std::runtime_error("Unsupported token stream version in " + filename);
+        // Divide rather than multiply, so a huge token_count cannot wrap around
+        if (header.token_count > (data.size() - sizeof(header)) / sizeof(TokenRecord))
+            throw std::runtime_error("Truncated token stream " + filename);
+        records = reinterpret_cast<const TokenRecord *>(data.data() + sizeof(header));
+        count = header.token_count;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (records[i].kind >= header.kind_count)
+                throw std::runtime_error("Invalid token kind in " + filename);
+        }
+    }
+
+    static bool isTokenStream(std::string_view data)
+    {
+        return data.size() >= sizeof(TokenStreamHeader) &&
+               memcmp(data.data(), TOKEN_STREAM_MAGIC, sizeof(TOKEN_STREAM_MAGIC)) == 0;
+    }
+
+    size_t size() const { return count; }
+    const TokenRecord *begin() const { return records; }
+    const TokenRecord *end() const { return records + count; }
+};
+
+#endif